@@ -0,0 +1,211 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "esp_log.h"
+#include "rvswd.h"
+#include "rvswd_ch32v20x.h"
+#include "rvswd_frame.h"
+#include "rvswd_mock.h"
+#include "rvswd_sim.h"
+#include "rvswd_source.h"
+#include "rvswd_stats.h"
+#include "sdkconfig.h"
+
+#define FRAMES 200000
+
+#define TARGET_FLASH 0x08000000  // Start of the target code flash
+#define TARGET_SRAM  0x20000000  // Start of the target SRAM
+#define WORDS        256         // Accesses of the single word scenarios
+
+// Every result is printed as a single line holding a JSON object, filter the output on lines starting with '{'
+
+static volatile uint32_t sink;  // Keeps the encoded frames from being optimized away
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void report(char const* scenario, uint32_t frames, int64_t elapsed_us) {
+    printf("{\"scenario\":\"%s\",\"frames\":%" PRIu32 ",\"cpu_us\":%" PRId64 ",\"frames_per_s\":%" PRId64 "}\n",
+           scenario, frames, elapsed_us, elapsed_us ? (int64_t)frames * 1000000 / elapsed_us : 0);
+}
+
+static void benchmark_encode(void) {
+    uint8_t buffer[RVSWD_FRAME_WRITE_BYTES];
+    uint32_t checksum = 0;
+    int64_t start = now_us();
+    for (uint32_t i = 0; i < FRAMES; i++) {
+        rvswd_frame_encode_write(i & 0x7F, i * 2654435761u, buffer);
+        checksum += buffer[i % sizeof(buffer)];
+    }
+    report("encode", FRAMES, now_us() - start);
+    sink = checksum;
+}
+
+static void benchmark_mock(void) {
+    rvswd_mock_t mock = {0};
+    rvswd_handle_t handle = {
+        .transport = &rvswd_transport_mock,
+        .transport_ctx = &mock,
+    };
+    rvswd_init(&handle);
+
+    int64_t start = now_us();
+    for (uint32_t i = 0; i < FRAMES; i++) {
+        rvswd_write(&handle, i & 0x7F, i);
+    }
+    report("mock_write", FRAMES, now_us() - start);
+
+    uint32_t value;
+    start = now_us();
+    for (uint32_t i = 0; i < FRAMES; i++) {
+        rvswd_read(&handle, i & 0x7F, &value);
+    }
+    report("mock_read", FRAMES, now_us() - start);
+}
+
+// Programming scenarios, run against a CH32V203 when CONFIG_BENCHMARK_HARDWARE is set and against the simulator
+// (rvswd_sim.h) otherwise. Time is taken from rvswd_time_us, the simulated time when running on the simulator.
+
+typedef struct scenario {
+    char const* name;
+    bool (*run)(rvswd_handle_t* handle, uint32_t size, uint32_t flags);
+    uint32_t size;   // Bytes transferred or programmed
+    uint32_t flags;  // Programming flags
+} scenario_t;
+
+// Image contents generated on the fly, so even the 64K image does not take any RAM
+static bool image_read(void* ctx, size_t offset, void* buffer, size_t length) {
+    uint32_t seed = *(uint32_t const*)ctx;
+    uint8_t* bytes = buffer;
+    for (size_t i = 0; i < length; i++) {
+        uint32_t x = (offset + i) * 2654435761u + seed;
+        bytes[i] = x ^ (x >> 13);
+    }
+    return true;
+}
+
+static uint32_t image_seed;
+
+static bool run_program(rvswd_handle_t* handle, uint32_t size, uint32_t flags) {
+    image_seed++;  // A new image every time, so no scenario finds the flash already programmed
+    rvswd_source_t image = {.read = image_read, .ctx = &image_seed, .length = size};
+    return ch32v20x_program_source(handle, &image, flags, NULL, NULL);
+}
+
+static bool run_connect(rvswd_handle_t* handle, uint32_t size, uint32_t flags) {
+    handle->clock_hz = 0;  // Include tuning the clock
+    handle->clock_tuned = false;
+    return rvswd_init(handle) == RVSWD_OK && rvswd_reset(handle) == RVSWD_OK &&
+           ch32v20x_connect(handle) == RVSWD_OK && ch32v20x_halt_microprocessor(handle) == RVSWD_OK;
+}
+
+static bool run_read_word(rvswd_handle_t* handle, uint32_t size, uint32_t flags) {
+    uint32_t value;
+    for (uint32_t i = 0; i < size / 4; i++) {
+        if (!ch32v20x_read_memory_word(handle, TARGET_SRAM + i * 4, &value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool run_write_word(rvswd_handle_t* handle, uint32_t size, uint32_t flags) {
+    for (uint32_t i = 0; i < size / 4; i++) {
+        if (!ch32v20x_write_memory_word(handle, TARGET_SRAM + i * 4, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool run_read_block(rvswd_handle_t* handle, uint32_t size, uint32_t flags) {
+    static uint32_t data[1024];
+    return size <= sizeof(data) && ch32v20x_read_memory_block(handle, TARGET_FLASH, data, size / 4);
+}
+
+// Program the image of the previous scenario again, every page is found unchanged
+static bool run_reflash(rvswd_handle_t* handle, uint32_t size, uint32_t flags) {
+    rvswd_source_t image = {.read = image_read, .ctx = &image_seed, .length = size};
+    return ch32v20x_program_source(handle, &image, flags, NULL, NULL);
+}
+
+#define PROGRAM_VERIFY    (CH32V20X_PROGRAM_LOADER | CH32V20X_PROGRAM_VERIFY_CRC)
+#define PROGRAM_NO_VERIFY (CH32V20X_PROGRAM_LOADER)
+
+static scenario_t const scenarios[] = {
+    {"connect", run_connect, 0, 0},
+    {"read_word", run_read_word, WORDS * 4, 0},
+    {"write_word", run_write_word, WORDS * 4, 0},
+    {"read_4k", run_read_block, 4096, 0},
+    {"program_16k", run_program, 16384, PROGRAM_VERIFY},
+    {"program_16k_no_verify", run_program, 16384, PROGRAM_NO_VERIFY},
+    {"program_64k", run_program, 65536, PROGRAM_VERIFY},
+    {"program_64k_no_verify", run_program, 65536, PROGRAM_NO_VERIFY},
+    {"program_16k_default", run_program, 16384, CH32V20X_PROGRAM_DEFAULT},
+    {"reflash_16k", run_reflash, 16384, CH32V20X_PROGRAM_DEFAULT},
+};
+
+static void benchmark_target(void) {
+#if CONFIG_BENCHMARK_HARDWARE
+    char const* target = "hardware";
+    rvswd_handle_t handle = {
+        .transport = &rvswd_transport_gpio,  // Set before rvswd_init, the scenarios take the time from the transport
+        .swdio = CONFIG_BENCHMARK_SWDIO,
+        .swclk = CONFIG_BENCHMARK_SWCLK,
+    };
+#else
+    char const* target = "sim";
+    rvswd_handle_t handle = {0};
+    rvswd_sim_t* sim = rvswd_sim_create(&rvswd_sim_ch32v203, &handle);
+    if (sim == NULL) {
+        return;
+    }
+#endif
+
+#if !CONFIG_RVSWD_STATS
+    ESP_LOGW("benchmark", "CONFIG_RVSWD_STATS is disabled, frames are not counted");
+#endif
+
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        scenario_t const* scenario = &scenarios[i];
+        rvswd_stats_t stats;
+        rvswd_stats_reset(&handle);
+        int64_t cpu_start = now_us();
+        int64_t start = rvswd_time_us(&handle);
+        bool ok = scenario->run(&handle, scenario->size, scenario->flags);
+        int64_t elapsed_us = rvswd_time_us(&handle) - start;
+        int64_t cpu_us = now_us() - cpu_start;
+        rvswd_stats_get(&handle, &stats);
+
+        uint32_t frames = stats.frames_written + stats.frames_read;
+        printf("{\"scenario\":\"%s\",\"target\":\"%s\",\"ok\":%s,\"bytes\":%" PRIu32 ",\"time_us\":%" PRId64
+               ",\"cpu_us\":%" PRId64 ",\"frames\":%" PRIu32 ",\"frames_written\":%" PRIu32 ",\"frames_read\":%" PRIu32
+               ",\"clock_hz\":%" PRIu32 ",\"bytes_per_s\":%" PRId64 ",\"frames_per_byte\":%.3f}\n",
+               scenario->name, target, ok ? "true" : "false", scenario->size, elapsed_us, cpu_us, frames,
+               stats.frames_written, stats.frames_read, handle.clock_hz,
+               elapsed_us ? (int64_t)scenario->size * 1000000 / elapsed_us : 0,
+               scenario->size ? (double)frames / scenario->size : 0.0);
+    }
+
+#if !CONFIG_BENCHMARK_HARDWARE
+    rvswd_sim_destroy(sim);
+#endif
+}
+
+void app_main(void) {
+    esp_log_level_set("*", ESP_LOG_WARN);
+    benchmark_encode();
+    benchmark_mock();
+    benchmark_target();
+}
@@ -9,6 +9,7 @@
 #include "esp_err.h"
 #include "esp_log.h"
 #include "rvswd_ch32v20x.h"
+#include "rvswd_stats.h"
 
 static const char* TAG = "example";
 
@@ -19,22 +20,50 @@ void callback(char const* msg, uint8_t progress) {
     ESP_LOGI(TAG, "%s: %d%%", msg, progress);
 }
 
+static void print_stats(rvswd_handle_t* handle) {
+    static char const* const phases[RVSWD_STATS_PHASES] = {"halt", "erase", "program", "verify", "flash busy"};
+    rvswd_stats_t stats;
+    if (!rvswd_stats_get(handle, &stats)) {
+        return;  // Enable CONFIG_RVSWD_STATS to collect them
+    }
+    ESP_LOGI(TAG, "%" PRIu32 " frames written, %" PRIu32 " read, %" PRIu32 " polls, %" PRIu32 " parity errors",
+             stats.frames_written, stats.frames_read, stats.polls, stats.errors.parity);
+    for (size_t i = 0; i < RVSWD_STATS_PHASES; i++) {
+        rvswd_stats_timing_t const* timing = &stats.phases[i];
+        if (timing->count) {
+            ESP_LOGI(TAG, "%-10s %4" PRIu32 "x min %6" PRIu32 " us max %6" PRIu32 " us avg %6" PRIu64 " us", phases[i],
+                     timing->count, timing->min_us, timing->max_us, timing->total_us / timing->count);
+        }
+    }
+}
+
 static void flash_coprocessor(void) {
     rvswd_handle_t handle = {
         .swdio = 22,
         .swclk = 23,
     };
 
+    // Connect once for both operations, the target stays halted until the session is closed
+    if (!ch32v20x_session_open(&handle, true)) {
+        ESP_LOGE(TAG, "Failed to connect to the CH32V203 microcontroller");
+        return;
+    }
+
     ch32v20x_read_option_bytes(&handle);
 
-    bool success = ch32v20x_program(&handle, coprocessor_firmware_start,
-                                    coprocessor_firmware_end - coprocessor_firmware_start, callback);
+    ch32v20x_program_stats_t stats;
+    bool success = ch32v20x_program_ex(&handle, coprocessor_firmware_start,
+                                       coprocessor_firmware_end - coprocessor_firmware_start, CH32V20X_PROGRAM_DEFAULT,
+                                       callback, &stats);
+    success &= ch32v20x_session_close(&handle, true);
 
     if (success) {
-        ESP_LOGI(TAG, "Succesfully flashed the CH32V203 microcontroller");
+        ESP_LOGI(TAG, "Succesfully flashed the CH32V203 microcontroller (%" PRIu32 " of %" PRIu32 " pages unchanged)",
+                 stats.pages_skipped, stats.pages_total);
     } else {
         ESP_LOGE(TAG, "Failed to flash the CH32V203 microcontroller");
     }
+    print_stats(&handle);
 
     // vTaskDelay(pdMS_TO_TICKS(5000));
     // esp_restart();
@@ -10,6 +10,7 @@
 
 // Addresses
 #define CH32V20X_ADDR_OPTION_BYTES 0x1FFFF800
+#define CH32V20X_ADDR_ESIG_FLACAP  0x1FFFF7E0  // Flash capacity in KB in the lower 16 bits
 
 // CH32V20X and CH32V30X flash status register
 #define CH32V20X_FLASH_STATR_BSY      (1 << 0)  // Flash is busy writing or erasing
@@ -20,7 +21,7 @@
 
 // CH32V20X and CH32V30X flash control register
 #define CH32V20X_FLASH_CTLR_PG     (1 << 0)   // Perform standard programming operation
-#define CH32V20X_FLASH_CTLR_PER    (1 << 1)   // Perform 1K sector erase
+#define CH32V20X_FLASH_CTLR_PER    (1 << 1)   // Perform 4K sector erase
 #define CH32V20X_FLASH_CTLR_MER    (1 << 2)   // Perform full Flash erase
 #define CH32V20X_FLASH_CTLR_OBG    (1 << 4)   // Perform user-selected word program
 #define CH32V20X_FLASH_CTLR_OBER   (1 << 5)   // Perform user-selected word erasure
@@ -8,6 +8,13 @@
 
 // Register definitions from the CH32X035 reference manual
 
+// Addresses
+#define CH32X035_ADDR_OPTION_BYTES 0x1FFFF800
+#define CH32X035_ADDR_ESIG_FLACAP  0x1FFFF7E0  // Flash capacity in KB in the lower 16 bits
+#define CH32X035_FLASH_STATR       0x4002200C  // Flash status register
+#define CH32X035_FLASH_CTLR        0x40022010  // Flash control register
+#define CH32X035_FLASH_ADDR        0x40022014  // Flash address register
+
 // CH32X035 flash status register
 #define CH32X035_FLASH_STATR_BSY         (1 << 0)   // Flash is busy writing or erasing
 #define CH32X035_FLASH_STATR_WRPRTERR    (1 << 4)   // Flash write protection error
@@ -1,4 +1,3 @@
-
 /**
  * Copyright (c) 2025 Nicolai Electronics
  *
@@ -7,23 +6,187 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
-#include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
 
-typedef struct rvswd_handle {
-    gpio_num_t swdio;
-    gpio_num_t swclk;
-} rvswd_handle_t;
+#if CONFIG_IDF_TARGET_LINUX
+typedef int gpio_num_t;
+#else
+#include "driver/gpio.h"
+#endif
+
+typedef struct rvswd_handle rvswd_handle_t;
 
 typedef enum rvswd_result {
     RVSWD_OK = 0,
     RVSWD_FAIL = 1,
     RVSWD_INVALID_ARGS = 2,
     RVSWD_PARITY_ERROR = 3,
+    RVSWD_TIMEOUT = 4,
 } rvswd_result_t;
 
+#define RVSWD_DEFAULT_TIMEOUT_US 50000       // Timeout for target state changes when the handle leaves it at 0
+#define RVSWD_POLL_MAX_DELAY_US  256         // Upper bound of the backoff between polls
+#define RVSWD_CLOCK_MIN_HZ       100000      // Slowest clock the handle steps down to
+#define RVSWD_READ_RETRIES       3           // Repeats of a read frame failing the parity check
+#define RVSWD_WAIT_FOREVER       UINT32_MAX  // Timeout of rvswd_lock that never expires
+
+// Operations used to drive the SWDIO and SWCLK lines
+typedef struct rvswd_transport {
+    // Configure the lines
+    rvswd_result_t (*init)(rvswd_handle_t* handle);
+    // Generate a start condition, leaves the clock low
+    void (*start)(rvswd_handle_t* handle);
+    // Generate a stop condition, leaves both lines high
+    void (*stop)(rvswd_handle_t* handle);
+    // Clock out the line reset sequence
+    void (*reset)(rvswd_handle_t* handle);
+    // Clock out the lowest count bits MSB first, data is sampled on the rising edge
+    void (*write_bits)(rvswd_handle_t* handle, uint32_t bits, uint8_t count);
+    // Release SWDIO and clock in count bits MSB first, data is output on the rising edge
+    uint32_t (*read_bits)(rvswd_handle_t* handle, uint8_t count);
+    // Optional, transfer a complete frame including the start and stop condition in one go
+    rvswd_result_t (*write_frame)(rvswd_handle_t* handle, uint8_t reg, uint32_t value);
+    rvswd_result_t (*read_frame)(rvswd_handle_t* handle, uint8_t reg, uint32_t* value);
+    // Optional, busy wait and time base for timeouts, the system timer is used when left NULL
+    void (*delay_us)(rvswd_handle_t* handle, uint32_t us);
+    int64_t (*time_us)(rvswd_handle_t* handle);
+    // Optional, apply a changed handle->clock_hz, the bit-banged transports follow handle->clock_cycles instead
+    rvswd_result_t (*set_clock)(rvswd_handle_t* handle);
+    // Optional, for transports combining the reads of several targets: whether (value & mask) == expected held for
+    // every target in the last read frame, rvswd_poll only succeeds when it did
+    bool (*match)(rvswd_handle_t* handle, uint32_t mask, uint32_t expected);
+    // Frames wait on a driver and can not be issued with interrupts masked
+    bool blocking;
+} rvswd_transport_t;
+
+// Debug module state the target drivers know to be loaded, writes that would not change it are skipped
+typedef struct rvswd_cache {
+    uint32_t progbuf[8];     // Contents of PROGBUF0..7
+    uint32_t gpr[32];        // Contents of x0..x31
+    uint32_t progbuf_valid;  // Bit per program buffer register holding a known value
+    uint32_t gpr_valid;      // Bit per general purpose register holding a known value
+    uint32_t hits;           // Register writes skipped, a PROGBUF write is one frame and a GPR write two
+    uint32_t misses;         // Register writes sent to the target
+} rvswd_cache_t;
+
+// Transfer errors seen on the handle, writes are not acknowledged by the target so only reads are checked
+typedef struct rvswd_errors {
+    uint32_t parity;     // Read frames failing the parity check
+    uint32_t retries;    // Read frames repeated after a parity error
+    uint32_t slowdowns;  // Clock steps down after repeated parity errors
+    uint32_t cmderr;     // Abstract commands failing, as reported by ABSTRACTCS to a target driver
+    uint32_t repeats;    // Register, word and block accesses repeated by a target driver after a failure
+} rvswd_errors_t;
+
+// Contention of the handle lock between tasks, see rvswd_lock
+typedef struct rvswd_lock_stats {
+    uint32_t acquired;     // Times the lock was taken, not counting nested takes by the task holding it
+    uint32_t contended;    // Takes that found the lock held by another task and waited for it
+    uint32_t timeouts;     // Takes that gave up after their timeout
+    uint32_t max_wait_us;  // Longest wait of a contended take
+    uint64_t wait_us;      // Sum of the waits of all contended takes
+} rvswd_lock_stats_t;
+
+// Phases timed when CONFIG_RVSWD_STATS is enabled, see rvswd_stats.h
+typedef enum rvswd_stats_phase {
+    RVSWD_STATS_HALT = 0,        // Halting the core
+    RVSWD_STATS_ERASE = 1,       // A single page, sector or mass erase
+    RVSWD_STATS_PROGRAM = 2,     // Programming a page
+    RVSWD_STATS_VERIFY = 3,      // Verifying a page
+    RVSWD_STATS_FLASH_BUSY = 4,  // Waiting for the flash controller
+    RVSWD_STATS_PHASES = 5,
+} rvswd_stats_phase_t;
+
+#define RVSWD_STATS_BUCKETS 8  // Histogram buckets, bucket n counts durations below 16 << 2n us, the last the rest
+
+typedef struct rvswd_stats_timing {
+    uint32_t count;                           // Number of times the phase ran
+    uint32_t min_us;                          // Shortest duration
+    uint32_t max_us;                          // Longest duration
+    uint64_t total_us;                        // Sum of all durations, divide by count for the average
+    uint32_t histogram[RVSWD_STATS_BUCKETS];  // Durations per bucket, 16, 64, 256 us, 1, 4, 16, 64 ms and longer
+} rvswd_stats_timing_t;
+
+typedef struct rvswd_stats {
+    uint32_t frames_written;                          // Write frames sent
+    uint32_t frames_read;                             // Read frames sent, including repeats
+    uint32_t polls;                                   // Status reads by rvswd_poll, DMSTATUS and ABSTRACTCS
+    rvswd_errors_t errors;                            // Copy of the error counters of the handle
+    rvswd_lock_stats_t lock;                          // Copy of the lock counters of the handle
+    rvswd_stats_timing_t phases[RVSWD_STATS_PHASES];  // Durations per phase
+} rvswd_stats_t;
+
+struct rvswd_handle {
+    gpio_num_t swdio;
+    gpio_num_t swclk;
+    rvswd_transport_t const* transport;  // Line driver, the GPIO transport is used when left NULL
+    void* transport_ctx;                 // Transport specific state
+    void const* target;                  // Family of the attached target, set by the target driver (rvswd_ch32.h)
+    uint32_t target_state;               // State of the attached target, set by the target driver (rvswd_ch32.h)
+    uint32_t timeout_us;                 // Timeout for target state changes, RVSWD_DEFAULT_TIMEOUT_US when 0
+    rvswd_cache_t cache;                 // Shadow of the debug module state, see rvswd_cache_invalidate
+    uint32_t clock_hz;                   // SWCLK frequency, 0 runs as fast as the transport goes
+    bool clock_tuned;                    // Set by rvswd_tune_clock, targets do not tune the clock again when set
+    uint32_t clock_cycles;               // CPU cycles per half SWCLK period, derived from clock_hz
+    uint32_t abstractauto;               // Last value written to ABSTRACTAUTO, reads repeating commands are not retried
+    rvswd_errors_t errors;               // Counters, never reset by the driver
+    SemaphoreHandle_t lock;              // Recursive mutex arbitrating the handle between tasks, see rvswd_lock
+    StaticSemaphore_t lock_buffer;       // Storage of lock
+    uint32_t lock_depth;                 // Nested takes of the task holding lock
+    uint32_t lock_waiters;               // Tasks blocked on lock
+    rvswd_lock_stats_t lock_stats;       // Contention of lock, read them through rvswd_stats_get
+#if CONFIG_RVSWD_STATS
+    rvswd_stats_t stats;                 // Performance counters, read them through rvswd_stats_get
+#endif
+};
+
+#if !CONFIG_IDF_TARGET_LINUX
+// Drives the lines by writing the GPIO output registers directly
+extern rvswd_transport_t const rvswd_transport_gpio;
+#endif
+
+// Configure the transport. Creates the lock of the handle, so it must be called before the handle is shared between
+// tasks.
 rvswd_result_t rvswd_init(rvswd_handle_t* handle);
 rvswd_result_t rvswd_reset(rvswd_handle_t* handle);
 rvswd_result_t rvswd_write(rvswd_handle_t* handle, uint8_t reg, uint32_t value);
 rvswd_result_t rvswd_read(rvswd_handle_t* handle, uint8_t reg, uint32_t* value);
+
+// Change the clock frequency, 0 runs as fast as the transport goes. A read frame failing the parity check is
+// repeated, unless reading the register again would repeat an abstract command. The frequency is lowered a step
+// when the repeat fails too or the frame can not be repeated.
+rvswd_result_t rvswd_set_clock(rvswd_handle_t* handle, uint32_t clock_hz);
+
+// Find the fastest clock at which every value written to reg reads back unchanged and without parity errors, reg
+// must be a plain read/write register such as DATA0. Sets clock_tuned, fails when even the slowest clock fails.
+rvswd_result_t rvswd_tune_clock(rvswd_handle_t* handle, uint8_t reg);
+
+// Take the handle for transactions that must not be interleaved with those of other tasks, waiting at most
+// timeout_ms for the task holding it, RVSWD_TIMEOUT when it was not released in time. The lock is recursive, every
+// take is paired with rvswd_unlock. Batches and the operations of the target drivers take it for a transaction or a
+// stub running on the target at a time and release it while waiting for the flash, so a task can access the target
+// while another task programs it. Frames sent with rvswd_read and rvswd_write are not locked, a sequence of them must
+// be taken explicitly. A task releasing the lock while another waits for it yields, so a waiting task of the same or
+// a higher priority gets the lock before it is taken again.
+rvswd_result_t rvswd_lock(rvswd_handle_t* handle, uint32_t timeout_ms);
+void rvswd_unlock(rvswd_handle_t* handle);
+
+// Whether another task waits for the lock, lets the task holding it put off work that does not need the handle
+bool rvswd_lock_waiting(rvswd_handle_t* handle);
+
+// Forget the shadowed debug module state, the hit and miss counters are kept
+void rvswd_cache_invalidate(rvswd_handle_t* handle);
+
+void rvswd_delay_us(rvswd_handle_t* handle, uint32_t us);
+int64_t rvswd_time_us(rvswd_handle_t* handle);
+
+// Wait between two polls, delay_us starts at 0 for back-to-back polls and doubles up to RVSWD_POLL_MAX_DELAY_US
+void rvswd_backoff(rvswd_handle_t* handle, uint32_t* delay_us);
+
+// Read reg until (value & mask) == expected or timeout_us passed, the last value read is stored in value
+rvswd_result_t rvswd_poll(rvswd_handle_t* handle, uint8_t reg, uint32_t mask, uint32_t expected, uint32_t timeout_us,
+                          uint32_t* value);
@@ -0,0 +1,38 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "rvswd.h"
+
+// Queue of register accesses executed back to back with interrupts masked
+
+typedef struct rvswd_batch_entry {
+    uint8_t reg;
+    bool read;
+    uint32_t value;    // Value to write
+    uint32_t* result;  // Destination of the value read, may be NULL
+} rvswd_batch_entry_t;
+
+typedef struct rvswd_batch {
+    rvswd_batch_entry_t* entries;  // Caller provided storage
+    size_t capacity;
+    size_t count;
+} rvswd_batch_t;
+
+void rvswd_batch_init(rvswd_batch_t* batch, rvswd_batch_entry_t* entries, size_t capacity);
+void rvswd_batch_clear(rvswd_batch_t* batch);
+
+// Queue a register access, returns RVSWD_INVALID_ARGS when the batch is full
+rvswd_result_t rvswd_batch_write(rvswd_batch_t* batch, uint8_t reg, uint32_t value);
+rvswd_result_t rvswd_batch_read(rvswd_batch_t* batch, uint8_t reg, uint32_t* result);
+
+// Execute all queued accesses holding the lock of the handle, stops at the first failing entry and stores its index
+// in failed_index (optional)
+rvswd_result_t rvswd_batch_execute(rvswd_handle_t* handle, rvswd_batch_t* batch, size_t* failed_index);
@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "rvswd.h"
+
+// Description of a CH32 family. Every family shares the debug module and the SRAM layout of the stubs, the flash
+// functions of rvswd_ch32v20x.h take everything that differs from the descriptor. The descriptor is looked up once
+// when the target is attached and kept in handle->target, so supporting more families adds nothing per page or word.
+
+#define CH32_ADDR_CHIP_ID  0x1FFFF704  // Chip ID, the family and the model of the target
+#define CH32_MAX_PAGE_SIZE 256         // Largest page_size of any family
+
+// State of the attached target, kept in handle->target_state by the target driver so operations skip work that is
+// already done. Running the core clears every flag but CH32_STATE_OPEN.
+typedef enum ch32_state {
+    CH32_STATE_OPEN = (1 << 0),      // A session is open, operations do not attach and release the target themselves
+    CH32_STATE_HALTED = (1 << 1),    // The core is halted
+    CH32_STATE_UNLOCKED = (1 << 2),  // The flash is unlocked and no flash operation is left running
+    CH32_STATE_LOADER = (1 << 3),    // The flash loader of the family is in SRAM
+    CH32_STATE_CRC32 = (1 << 4),     // The CRC32 stub is in SRAM
+} ch32_state_t;
+
+typedef struct ch32_family {
+    char const* name;
+    uint32_t chip_id_mask;        // Bits of the chip ID that identify the family
+    uint32_t chip_id;             // Value of those bits
+    uint32_t flash_begin;         // Start of the code flash
+    uint32_t max_pages;           // Pages in the largest flash of the family
+    uint32_t page_size;           // Size of a fast programming and fast erase page
+    uint32_t erase_size;          // Size of the erase selected by erase_ctlr
+    uint32_t erase_ctlr;          // CTLR bit of the largest erase short of a mass erase
+    uint32_t flash_statr;         // Flash status register
+    uint32_t flash_ctlr;          // Flash control register
+    uint32_t flash_addr;          // Flash address register
+    uint32_t flash_capacity;      // Electronic signature holding the flash size in KB in the lower 16 bits
+    uint32_t option_bytes;        // Start of the option bytes
+    uint32_t const (*keys)[2];    // Register and value of every word written to unlock the flash, in order
+    size_t key_count;             // Number of entries in keys
+    uint32_t const* loader;       // Flash loader, programs the erased page at a2 with the data at a3, returns STATR
+    size_t loader_words;          // Size of the flash loader in words
+    uint32_t loader_clobber;      // Registers changed by the flash loader, a bit per register
+    // Program an erased page from the host when the flash loader is not used, the flash must be unlocked
+    bool (*write_page)(rvswd_handle_t* handle, uint32_t addr, void const* data);
+} ch32_family_t;
+
+extern ch32_family_t const ch32_family_ch32v20x;
+extern ch32_family_t const ch32_family_ch32x035;
+
+// Read the chip ID of the halted target and look up its family, NULL when the family is not supported
+ch32_family_t const* ch32_family_detect(rvswd_handle_t* handle);
+
+// Family of the attached target, set by ch32v20x_attach. On a handle that was not attached the family is detected on
+// first use, which needs a halted target. NULL when the family is not supported, the flash functions fail without one.
+ch32_family_t const* ch32_family(rvswd_handle_t* handle);
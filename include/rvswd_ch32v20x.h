@@ -9,16 +9,85 @@
 
 #include <stdint.h>
 #include "rvswd.h"
+#include "rvswd_ch32.h"
+#include "rvswd_source.h"
 
 typedef void (*ch32v20x_status_callback)(char const* msg, uint8_t progress);
 
+typedef enum ch32v20x_phase {
+    CH32V20X_PHASE_ERASE = 0,  // About to erase the pages that are written
+    CH32V20X_PHASE_WRITE = 1,  // About to write the page at addr, page index of total in the image
+    CH32V20X_PHASE_DONE = 2,   // Programming finished
+} ch32v20x_phase_t;
+
+// Progress of the _ex programming functions, addr, index and total are only set for the erase and write phases.
+// Returning false cancels programming before the next page, the target is left halted with the flash partly written.
+typedef bool (*ch32v20x_progress_callback)(void* ctx, ch32v20x_phase_t phase, uint32_t addr, size_t index,
+                                           size_t total);
+
+typedef enum ch32v20x_program_flags {
+    CH32V20X_PROGRAM_LOADER = (1 << 0),           // Program pages with a flash loader running from the target SRAM
+    CH32V20X_PROGRAM_VERIFY_CRC = (1 << 1),       // Verify pages against a CRC32 calculated by the target
+    CH32V20X_PROGRAM_VERIFY_READBACK = (1 << 2),  // Verify pages by reading them back
+    CH32V20X_PROGRAM_DIFFERENTIAL = (1 << 3),     // Skip pages that already hold the image contents
+    CH32V20X_PROGRAM_FINGERPRINT = (1 << 4),      // Store the length and CRC32 of the image in the last flash page
+    CH32V20X_PROGRAM_MASS_ERASE = (1 << 5),       // Allow a mass erase when every page of the image is written
+} ch32v20x_program_flags_t;
+
+#define CH32V20X_PROGRAM_DEFAULT \
+    (CH32V20X_PROGRAM_LOADER | CH32V20X_PROGRAM_VERIFY_CRC | CH32V20X_PROGRAM_DIFFERENTIAL)
+
+typedef struct ch32v20x_program_stats {
+    uint32_t pages_total;       // Pages covered by the image
+    uint32_t pages_written;     // Pages erased and programmed
+    uint32_t pages_skipped;     // Pages that already held the image contents
+    uint32_t erase_operations;  // Mass, sector and page erase operations issued
+    uint32_t pages_retried;     // Pages erased and programmed again after a failed attempt
+} ch32v20x_program_stats_t;
+
 // Option bytes
 bool ch32v20x_read_option_bytes(rvswd_handle_t* handle);
 
-// Program and restart the CH32V203
+// Program and restart the CH32V203. The family of the target is detected from its chip ID when it is attached, any
+// family of rvswd_ch32.h is programmed through these functions and the flash functions below.
 bool ch32v20x_program(rvswd_handle_t* handle, void const* firmware, size_t firmware_len,
                       ch32v20x_status_callback status_callback);
+bool ch32v20x_program_ex(rvswd_handle_t* handle, void const* firmware, size_t firmware_len, uint32_t flags,
+                         ch32v20x_status_callback status_callback, ch32v20x_program_stats_t* stats);
+
+// Program an image read page by page from a source, heap use does not depend on the size of the image. Each flag
+// in CH32V20X_PROGRAM_DIFFERENTIAL and CH32V20X_PROGRAM_FINGERPRINT adds a pass over the image, a source that can
+// only be read once must leave them out.
+bool ch32v20x_program_source(rvswd_handle_t* handle, rvswd_source_t const* firmware, uint32_t flags,
+                             ch32v20x_status_callback status_callback, ch32v20x_program_stats_t* stats);
+bool ch32v20x_program_source_ex(rvswd_handle_t* handle, rvswd_source_t const* firmware, uint32_t flags,
+                                ch32v20x_progress_callback progress, void* ctx, ch32v20x_program_stats_t* stats);
+
+// Program the selected targets of a gang transport (rvswd_gang.h) in lockstep, taking about as long as a single
+// target, all targets are programmed when none were selected yet. No page is skipped and no fingerprint is stored as
+// the targets may hold different images. Afterwards every target is verified on its own against a CRC32 of the
+// image, the targets that failed keep their error in the gang. Returns true when every target selected at the call
+// succeeded.
+bool ch32v20x_program_gang(rvswd_handle_t* handle, void const* firmware, size_t firmware_len, uint32_t flags,
+                           ch32v20x_status_callback status_callback, ch32v20x_program_stats_t* stats);
+
+// Check whether the fingerprint stored with CH32V20X_PROGRAM_FINGERPRINT matches the image, without reading the image
+// back
+bool ch32v20x_is_firmware_current(rvswd_handle_t* handle, void const* firmware, size_t firmware_len);
+bool ch32v20x_is_firmware_current_source(rvswd_handle_t* handle, rvswd_source_t const* firmware);
+
+// Keep the target attached across operations. Opening a session attaches the target, resetting it first when reset
+// is set, and unlocks the flash. Until the session is closed the target stays halted and unlocked: the operations
+// above and below skip attaching, unlocking and uploading stubs already done, and programming leaves the target
+// halted. Closing locks the flash and restarts the target, from reset when reset is set.
+bool ch32v20x_session_open(rvswd_handle_t* handle, bool reset);
+bool ch32v20x_session_close(rvswd_handle_t* handle, bool reset);
 
+// Activate the debug module after rvswd_init and rvswd_reset. The clock is tuned unless handle->clock_tuned is set or
+// handle->clock_hz holds a fixed frequency.
+rvswd_result_t ch32v20x_connect(rvswd_handle_t* handle);
+// Initialize the handle, connect, halt the target after a reset when reset is set and detect its family
+bool ch32v20x_attach(rvswd_handle_t* handle, bool reset);
 rvswd_result_t ch32v20x_halt_microprocessor(rvswd_handle_t* handle);
 rvswd_result_t ch32v20x_resume_microprocessor(rvswd_handle_t* handle);
 rvswd_result_t ch32v20x_reset_microprocessor_and_run(rvswd_handle_t* handle);
@@ -27,13 +96,28 @@ bool ch32v20x_read_cpu_reg(rvswd_handle_t* handle, uint16_t regno, uint32_t* val
 bool ch32v20x_run_debug_code(rvswd_handle_t* handle, void const* code, size_t code_size);
 bool ch32v20x_read_memory_word(rvswd_handle_t* handle, uint32_t address, uint32_t* value_out);
 bool ch32v20x_write_memory_word(rvswd_handle_t* handle, uint32_t address, uint32_t value);
+bool ch32v20x_read_memory_block(rvswd_handle_t* handle, uint32_t address, uint32_t* data, size_t count);
+bool ch32v20x_write_memory_block(rvswd_handle_t* handle, uint32_t address, uint32_t const* data, size_t count);
+// The flash functions take the family identified by ch32v20x_attach, or detect it on a halted target that was not
+// attached, and fail when the family is not supported
 bool ch32v20x_wait_flash(rvswd_handle_t* handle);
-void ch32v20x_wait_flash_write(rvswd_handle_t* handle);
+bool ch32v20x_wait_flash_write(rvswd_handle_t* handle);
 bool ch32v20x_unlock_flash(rvswd_handle_t* handle);
 bool ch32v20x_lock_flash(rvswd_handle_t* handle);
 bool ch32v20x_erase_flash_block(rvswd_handle_t* handle, uint32_t addr);
+bool ch32v20x_erase_flash_sector(rvswd_handle_t* handle, uint32_t addr);
+bool ch32v20x_erase_flash_all(rvswd_handle_t* handle);
 bool ch32v20x_write_flash_block(rvswd_handle_t* handle, uint32_t addr, void const* data);
 bool ch32v20x_write_flash(rvswd_handle_t* handle, uint32_t addr, void const* _data, size_t data_len,
                           ch32v20x_status_callback status_callback);
+bool ch32v20x_write_flash_ex(rvswd_handle_t* handle, uint32_t addr, void const* _data, size_t data_len,
+                             uint32_t flags, ch32v20x_status_callback status_callback,
+                             ch32v20x_program_stats_t* stats);
+bool ch32v20x_write_flash_source(rvswd_handle_t* handle, uint32_t addr, rvswd_source_t const* source, uint32_t flags,
+                                 ch32v20x_status_callback status_callback, ch32v20x_program_stats_t* stats);
+bool ch32v20x_write_flash_source_ex(rvswd_handle_t* handle, uint32_t addr, rvswd_source_t const* source,
+                                    uint32_t flags, ch32v20x_progress_callback progress, void* ctx,
+                                    ch32v20x_program_stats_t* stats);
+bool ch32v20x_crc32(rvswd_handle_t* handle, uint32_t addr, size_t len, uint32_t* crc_out);
 bool ch32v20x_clear_running_operations(rvswd_handle_t* handle);
 bool ch32v20x_read_option_bytes(rvswd_handle_t* handle);
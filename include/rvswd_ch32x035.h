@@ -0,0 +1,38 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "rvswd.h"
+#include "rvswd_ch32.h"
+#include "rvswd_ch32v20x.h"
+#include "rvswd_source.h"
+
+// Driver for the CH32X035. The debug module is the same as on the CH32V20X and the programming flow of
+// rvswd_ch32v20x.h runs on it through the ch32_family_ch32x035 descriptor (rvswd_ch32.h). The flash controller
+// differs: pages are loaded into the page buffer word by word with BUFLOAD before a single STRT programs them, and
+// 32K blocks can be erased at once with BER32.
+//
+// The programming functions are the ch32v20x ones, which detect the family from the chip ID.
+
+// Option bytes
+bool ch32x035_read_option_bytes(rvswd_handle_t* handle);
+
+// Program and restart the CH32X035
+bool ch32x035_program(rvswd_handle_t* handle, void const* firmware, size_t firmware_len,
+                      ch32v20x_status_callback status_callback);
+bool ch32x035_program_ex(rvswd_handle_t* handle, void const* firmware, size_t firmware_len, uint32_t flags,
+                         ch32v20x_status_callback status_callback, ch32v20x_program_stats_t* stats);
+bool ch32x035_program_source(rvswd_handle_t* handle, rvswd_source_t const* firmware, uint32_t flags,
+                             ch32v20x_status_callback status_callback, ch32v20x_program_stats_t* stats);
+
+// Flash operations, the flash must be unlocked with ch32v20x_unlock_flash and the core halted
+bool ch32x035_erase_flash_page(rvswd_handle_t* handle, uint32_t addr);
+bool ch32x035_erase_flash_block(rvswd_handle_t* handle, uint32_t addr);
+bool ch32x035_write_flash_page(rvswd_handle_t* handle, uint32_t addr, void const* data);
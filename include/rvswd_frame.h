@@ -0,0 +1,49 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "rvswd.h"
+
+// Bit level layout of the frames between the start and the stop condition, packed MSB first
+
+#define RVSWD_FRAME_HEADER_BITS  14  // Address, operation, parity and five trailer bits
+#define RVSWD_FRAME_DATA_BITS    33  // Data and parity
+#define RVSWD_FRAME_TRAILER_BITS 5   // Bits following the data parity
+#define RVSWD_FRAME_WRITE_BITS   (RVSWD_FRAME_HEADER_BITS + RVSWD_FRAME_DATA_BITS + RVSWD_FRAME_TRAILER_BITS)
+#define RVSWD_FRAME_WRITE_BYTES  ((RVSWD_FRAME_WRITE_BITS + 7) / 8)
+#define RVSWD_FRAME_HEADER_BYTES ((RVSWD_FRAME_HEADER_BITS + 7) / 8)
+
+#define RVSWD_FRAME_HEADER_TRAILER 0b10101  // Fixed bits following the header parity
+#define RVSWD_FRAME_DATA_TRAILER   0b10111  // Fixed bits following the data parity
+
+// Address, operation, parity and trailer of a frame as a single 14 bit word
+static inline uint16_t rvswd_frame_header(uint8_t reg, bool write) {
+    uint8_t address_op = ((reg & 0x7F) << 1) | write;
+    return (address_op << 6) | (__builtin_parity(address_op) << 5) | RVSWD_FRAME_HEADER_TRAILER;
+}
+
+// Data parity and trailer of a frame as a single 6 bit word
+static inline uint8_t rvswd_frame_trailer(uint32_t value) {
+    return (__builtin_parity(value) << 5) | RVSWD_FRAME_DATA_TRAILER;
+}
+
+// Encode a complete write frame into buffer (RVSWD_FRAME_WRITE_BYTES), returns the number of bits
+size_t rvswd_frame_encode_write(uint8_t reg, uint32_t value, uint8_t* buffer);
+
+// Encode the host driven header of a read frame into buffer (RVSWD_FRAME_HEADER_BYTES), returns the number of bits
+size_t rvswd_frame_encode_read(uint8_t reg, uint8_t* buffer);
+
+// Decode the data and parity of a read frame starting at bit offset in buffer
+rvswd_result_t rvswd_frame_decode_read(uint8_t const* buffer, size_t offset, uint32_t* value);
+
+// Check the parity of a data word clocked in during a read frame
+static inline rvswd_result_t rvswd_frame_check(uint32_t value, bool parity) {
+    return (__builtin_parity(value) == parity) ? RVSWD_OK : RVSWD_PARITY_ERROR;
+}
@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "rvswd.h"
+
+// Transport driving several targets in lockstep. The SWDIO lines of all targets are switched by a single write to
+// the GPIO set/clear registers and so are their SWCLK lines, so every clock edge moves one bit for all targets at
+// once. The data of a read frame is sampled from the GPIO input register once per bit and split per target after
+// the frame. The targets share one clock line or have their own, as long as all pins are in the first GPIO bank.
+//
+// Reads return the bitwise OR of the values of the selected targets, busy and error flags therefore read as set
+// while they are set on any target. The value of every target is kept in value, rvswd_poll waits until every target
+// returns the expected value. A target returning a parity error is deselected and keeps that error in result, the
+// frame only fails when no target is left.
+//
+// The selection and the errors are kept when rvswd_init runs again, as attaching a target does, so the targets
+// left out or failed stay out until rvswd_gang_clear.
+
+#define RVSWD_GANG_MAX 8  // Maximum number of targets in a gang
+
+// Lines driven by callbacks instead of the GPIO registers, for simulated targets (rvswd_sim.h). Bit n of a mask is
+// GPIO n, as in the GPIO registers.
+typedef struct rvswd_gang_port {
+    void (*write)(void* ctx, uint32_t set, uint32_t clear);  // Drive the lines in set high and those in clear low
+    uint32_t (*read)(void* ctx);                             // Level of every line, as the GPIO input register
+    void (*delay_us)(void* ctx, uint32_t us);                // Busy wait
+    int64_t (*time_us)(void* ctx);                           // Time base for timeouts
+    void* ctx;                                               // Passed to the callbacks
+} rvswd_gang_port_t;
+
+typedef struct rvswd_gang {
+    uint8_t count;                          // Number of targets
+    gpio_num_t swdio[RVSWD_GANG_MAX];       // SWDIO line per target, GPIO 0 to 31
+    gpio_num_t swclk[RVSWD_GANG_MAX];       // SWCLK line per target, targets may share a line
+    rvswd_gang_port_t const* port;          // Drives the lines when set, required on the Linux target
+    uint32_t selected;                      // Bit per target taking part in frames, all targets when 0 at rvswd_init
+    uint32_t value[RVSWD_GANG_MAX];         // Data of the last read frame per target
+    rvswd_result_t result[RVSWD_GANG_MAX];  // First error per target, a failed target can not be selected again
+    uint32_t swdio_mask;                    // GPIO mask of the SWDIO lines of the selected targets
+    uint32_t swclk_mask;                    // GPIO mask of the SWCLK lines of the selected targets
+} rvswd_gang_t;
+
+// Set handle->transport to this and handle->transport_ctx to an rvswd_gang_t, handle->swdio and handle->swclk are
+// not used
+extern rvswd_transport_t const rvswd_transport_gang;
+
+// Limit the following frames to the targets in mask that did not fail, returns the targets selected. An unselected
+// target has its SWDIO line held high so it never sees a start condition.
+uint32_t rvswd_gang_select(rvswd_handle_t* handle, uint32_t mask);
+
+// Record an error for a target found by a higher layer, for example a failed verification, and deselect it
+void rvswd_gang_fail(rvswd_handle_t* handle, uint8_t target, rvswd_result_t result);
+
+// Forget the errors of all targets and select them all, for example when the next set of targets is connected
+void rvswd_gang_clear(rvswd_handle_t* handle);
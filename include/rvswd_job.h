@@ -0,0 +1,77 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "rvswd.h"
+#include "rvswd_ch32v20x.h"
+#include "rvswd_source.h"
+
+// Programming job running ch32v20x_program_source_ex on a task of its own, so the caller does not block while the
+// target is programmed. The job reports through events posted to a queue created by the caller with room for
+// rvswd_job_event_t items. Progress events are dropped when the queue is full, the programmer never waits for the
+// receiver. The completion event is always posted, the job waits for room in the queue if it has to.
+
+#define RVSWD_JOB_DEFAULT_STACK_SIZE  6144  // Stack of the job task when the config leaves it at 0
+#define RVSWD_JOB_DEFAULT_PRIORITY    5     // Priority of the job task when the config leaves it at 0
+#define RVSWD_JOB_DEFAULT_INTERVAL_MS 100   // Time between progress events when the config leaves it at 0
+
+typedef struct rvswd_job rvswd_job_t;
+
+typedef enum rvswd_job_event_type {
+    RVSWD_JOB_PROGRESS = 0,  // Programming advanced, see progress
+    RVSWD_JOB_DONE = 1,      // The job finished, see success, cancelled and stats
+} rvswd_job_event_type_t;
+
+typedef struct rvswd_job_event {
+    rvswd_job_event_type_t type;
+    rvswd_job_t* job;                // Job posting the event
+    void* user_ctx;                  // From the job config
+    ch32v20x_phase_t phase;          // Phase of programming
+    uint32_t addr;                   // Page about to be written in the write phase
+    uint8_t progress;                // Percentage of the pages of the image passed
+    bool success;                    // Completion only, the target was programmed and restarted
+    bool cancelled;                  // Completion only, rvswd_job_cancel stopped programming
+    ch32v20x_program_stats_t stats;  // Completion only, statistics of the programming run
+} rvswd_job_event_t;
+
+typedef struct rvswd_job_config {
+    rvswd_handle_t* handle;   // Handle of the target, other tasks may only access target memory until the job is done
+    rvswd_source_t firmware;  // Image to program, read from the job task
+    uint32_t flags;           // ch32v20x_program_flags_t
+    QueueHandle_t queue;      // Receives the rvswd_job_event_t events
+    void* user_ctx;           // Passed along in every event
+    uint32_t stack_size;      // Stack of the job task in bytes
+    UBaseType_t priority;     // Priority of the job task, above the idle task
+    bool pin_to_core;         // Pin the job task to core, otherwise the scheduler picks the core
+    BaseType_t core;          // Core the job task is pinned to
+    uint32_t interval_ms;     // Least time between two progress events, the phase changing is always reported
+} rvswd_job_config_t;
+
+// Config with the default stack, priority and interval and the job task not pinned to a core. Fields left at 0 take
+// these defaults too, so a config only filling in the handle, firmware and queue is the same.
+#define RVSWD_JOB_CONFIG_DEFAULT()                     \
+    {                                                  \
+        .stack_size = RVSWD_JOB_DEFAULT_STACK_SIZE,    \
+        .priority = RVSWD_JOB_DEFAULT_PRIORITY,        \
+        .pin_to_core = false,                          \
+        .interval_ms = RVSWD_JOB_DEFAULT_INTERVAL_MS,  \
+    }
+
+// Start programming, returns NULL when the job could not be created. The job must be freed with rvswd_job_free after
+// its completion event was received.
+rvswd_job_t* rvswd_job_start(rvswd_job_config_t const* config);
+
+// Ask the job to stop before programming the next page, its completion event has cancelled set. The target is left
+// halted with its flash partly written.
+void rvswd_job_cancel(rvswd_job_t* job);
+
+void rvswd_job_free(rvswd_job_t* job);
@@ -0,0 +1,46 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "rvswd_source.h"
+
+// Source decompressing an image stored in an LZSS container made by tools/rvswd_compress.py. The image is decoded
+// into a small sliding window as it is read, no buffer the size of the image is needed. Reading an offset before
+// the last one read restarts decoding at the start of the container.
+//
+// Container layout, all values little endian:
+//   magic "RVZ1", uint32_t length of the decompressed image, followed by groups of eight tokens. Every group starts
+//   with a flag byte, bit 0 describing the first token. A set bit is a literal byte. A clear bit is a uint16_t with
+//   the distance back into the window in the upper 12 bits and the length minus 3 in the lower 4 bits. A distance
+//   of 0 is a run of erased bytes (0xFF) instead, its length follows as a uint16_t.
+
+#define RVSWD_LZSS_MAGIC       0x315A5652  // "RVZ1"
+#define RVSWD_LZSS_HEADER_SIZE 8           // Magic and decompressed length
+#define RVSWD_LZSS_WINDOW      4096        // Bytes a match can reach back
+#define RVSWD_LZSS_MIN_MATCH   3           // Shortest match encoded as a token
+#define RVSWD_LZSS_INPUT_CHUNK 64          // Bytes read from the container at once
+
+typedef struct rvswd_lzss {
+    rvswd_source_t const* input;                   // Container
+    size_t input_offset;                           // Offset in the container of the input buffer
+    size_t input_length;                           // Valid bytes in the input buffer
+    size_t input_position;                         // Next byte to use from the input buffer
+    size_t output_offset;                          // Offset in the image of the next byte decoded
+    uint16_t copy_distance;                        // Distance of the match being copied, 0 for a run of 0xFF
+    uint16_t copy_length;                          // Bytes left of the match being copied
+    uint8_t flags;                                 // Flag byte of the current group
+    uint8_t flags_left;                            // Tokens left in the current group
+    uint8_t input_buffer[RVSWD_LZSS_INPUT_CHUNK];  // Container bytes read ahead
+    uint8_t window[RVSWD_LZSS_WINDOW];             // Last bytes decoded
+} rvswd_lzss_t;
+
+// Set up source to read the image in the container read from input, fails when input is not a container. The lzss
+// state must stay valid while source is used.
+bool rvswd_source_lzss(rvswd_source_t* source, rvswd_lzss_t* lzss, rvswd_source_t const* input);
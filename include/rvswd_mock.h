@@ -0,0 +1,29 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "rvswd.h"
+
+// Transport without hardware, reports every line event to callbacks so the frame logic can run on a host. Time
+// is simulated from the clocks generated and the delays requested, so timeouts do not depend on the host speed.
+
+typedef struct rvswd_mock {
+    void* user;                             // Passed to the callbacks
+    void (*start)(void* user);              // Start condition, optional
+    void (*stop)(void* user);               // Stop condition, optional
+    bool (*clock)(void* user, bool swdio);  // Rising clock edge with the level driven by the host, returns SWDIO
+    uint32_t clocks;                        // Number of clock cycles generated
+    uint32_t frames;                        // Number of start conditions generated
+    uint32_t clock_ns;                      // Duration of a clock cycle in the simulated time at full speed
+    uint64_t clocked_ns;                    // Time spent clocking, cycles take longer when handle->clock_hz is set
+    uint64_t delayed_us;                    // Time spent in delays, delays do not sleep
+} rvswd_mock_t;
+
+// Set handle->transport to this and handle->transport_ctx to an rvswd_mock_t
+extern rvswd_transport_t const rvswd_transport_mock;
@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "rvswd.h"
+#include "rvswd_mock.h"
+
+// Simulated CH32 target behind the mock transport, so the driver runs on the Linux target without any hardware. The
+// simulator decodes the RVSWD frames clocked by the mock transport and checks their parity, implements DMCONTROL,
+// DMSTATUS, ABSTRACTCS, ABSTRACTAUTO, the data registers, abstract register access and the program buffer, and
+// executes the RV32IC code of the program buffer and the stubs it calls from SRAM. The flash controller follows the
+// unlock key sequences for the controller and the fast programming mode, the FTER, PER, MER, FTPG and PGSTRT
+// operations, the BSY and WRPRTERR status bits and keeps busy for the durations in the configuration.
+//
+// All time is simulated: wire time follows the clock of the handle and the delays requested by the driver, which
+// return at once, so rvswd_sim_time_us reports what a run would take on real hardware.
+
+typedef struct rvswd_sim rvswd_sim_t;
+
+typedef struct rvswd_sim_config {
+    uint32_t chip_id;          // Value of the chip ID register
+    uint32_t flash_size;       // Code flash size in bytes
+    uint32_t sram_size;        // SRAM size in bytes
+    uint32_t erased_value;     // Value read from erased flash
+    uint32_t clock_ns;         // Duration of a single SWCLK cycle
+    uint32_t page_erase_us;    // Duration of a 256 byte fast page erase
+    uint32_t sector_erase_us;  // Duration of a sector or block erase
+    uint32_t mass_erase_us;    // Duration of a full flash erase
+    uint32_t page_program_us;  // Duration of a 256 byte page program
+} rvswd_sim_config_t;
+
+extern rvswd_sim_config_t const rvswd_sim_ch32v203;
+extern rvswd_sim_config_t const rvswd_sim_ch32x035;
+
+// Create a simulated target and attach it to handle through the mock transport
+rvswd_sim_t* rvswd_sim_create(rvswd_sim_config_t const* config, rvswd_handle_t* handle);
+void rvswd_sim_destroy(rvswd_sim_t* sim);
+
+// Simulated time since creation
+uint64_t rvswd_sim_time_us(rvswd_sim_t* sim);
+uint64_t rvswd_sim_time_ns(rvswd_sim_t* sim);
+
+// Direct access to the simulated flash, for preloading and checking contents
+uint8_t* rvswd_sim_flash(rvswd_sim_t* sim);
+
+// Make every read frame from now on fail with a parity error with a probability of one in rate (0 disables)
+void rvswd_sim_set_error_rate(rvswd_sim_t* sim, uint32_t rate);
+
+// Flip wire bits at random while the handle clock is faster than hz, as a long cable would (0 disables)
+void rvswd_sim_set_max_clock(rvswd_sim_t* sim, uint32_t hz);
+
+// Ignore write frames at random with a probability of one in rate, as a target seeing a corrupted frame would
+// (0 disables)
+void rvswd_sim_set_drop_rate(rvswd_sim_t* sim, uint32_t rate);
+
+typedef struct rvswd_sim_gang rvswd_sim_gang_t;
+
+// Create count simulated targets on the lines of a gang transport (rvswd_gang.h) and attach the gang to handle, target
+// n has configs[n] and its SWDIO line on GPIO 2n and its SWCLK line on GPIO 2n + 1. The targets decode the conditions
+// and clocks from the line levels the gang drives, a deselected target sees no clock but its time passes.
+rvswd_sim_gang_t* rvswd_sim_gang_create(rvswd_sim_config_t const* const* configs, uint8_t count,
+                                        rvswd_handle_t* handle);
+void rvswd_sim_gang_destroy(rvswd_sim_gang_t* sim_gang);
+
+// Simulated target number target of the gang, for the per target functions above
+rvswd_sim_t* rvswd_sim_gang_target(rvswd_sim_gang_t* sim_gang, uint8_t target);
@@ -0,0 +1,29 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Image data read on demand, so an image does not have to be resident in RAM while it is programmed. Offsets only
+// increase during a pass over the image, but programming can make more than one pass, see the programming flags.
+
+typedef struct rvswd_source {
+    bool (*read)(void* ctx, size_t offset, void* buffer, size_t length);  // Copy length bytes at offset into buffer
+    void* ctx;                                                            // Passed to read
+    size_t length;                                                        // Size of the image in bytes
+} rvswd_source_t;
+
+// Image in memory, including memory mapped flash
+void rvswd_source_memory(rvswd_source_t* source, void const* data, size_t length);
+
+// Image at the start of a file opened for reading
+void rvswd_source_file(rvswd_source_t* source, FILE* file, size_t length);
+
+// Read a range of the image, fails when the range is not inside the image
+bool rvswd_source_read(rvswd_source_t const* source, size_t offset, void* buffer, size_t length);
@@ -0,0 +1,14 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include "esp_partition.h"
+#include "rvswd_source.h"
+
+// Image at the start of a partition
+void rvswd_source_partition(rvswd_source_t* source, esp_partition_t const* partition, size_t length);
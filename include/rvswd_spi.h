@@ -0,0 +1,22 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include "driver/spi_master.h"
+#include "rvswd.h"
+
+// Transport clocking the body of every frame out with a single SPI transaction. The start and stop
+// conditions can not be generated by the SPI peripheral, the pins are switched back to plain GPIO for those.
+
+typedef struct rvswd_spi {
+    spi_host_device_t host;      // SPI peripheral, must not be used for anything else
+    int clock_speed_hz;          // SWCLK frequency during the frame body, a lower handle->clock_hz takes over
+    spi_device_handle_t device;  // Filled in by rvswd_init
+} rvswd_spi_t;
+
+// Set handle->transport to this and handle->transport_ctx to an rvswd_spi_t
+extern rvswd_transport_t const rvswd_transport_spi;
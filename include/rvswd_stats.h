@@ -0,0 +1,39 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "rvswd.h"
+
+// Performance counters of a handle, collected when CONFIG_RVSWD_STATS is enabled. The macros below are used by the
+// drivers to count and time their work, they expand to nothing when the option is disabled.
+
+#if CONFIG_RVSWD_STATS
+
+#define RVSWD_STATS_COUNT(handle, counter) ((handle)->stats.counter++)
+#define RVSWD_STATS_START(handle, timer)   int64_t timer = rvswd_time_us(handle)
+#define RVSWD_STATS_STOP(handle, phase, timer) \
+    rvswd_stats_record(handle, phase, (uint32_t)(rvswd_time_us(handle) - (timer)))
+
+// Add a duration to the timing of a phase
+void rvswd_stats_record(rvswd_handle_t* handle, rvswd_stats_phase_t phase, uint32_t duration_us);
+
+#else
+
+#define RVSWD_STATS_COUNT(handle, counter)
+#define RVSWD_STATS_START(handle, timer)
+#define RVSWD_STATS_STOP(handle, phase, timer)
+
+#endif
+
+// Copy the counters of handle to stats, returns false when statistics are not compiled in. The error and lock counters
+// are always copied.
+bool rvswd_stats_get(rvswd_handle_t* handle, rvswd_stats_t* stats);
+
+// Clear the counters and timings of handle, the error and lock counters are left alone
+void rvswd_stats_reset(rvswd_handle_t* handle);
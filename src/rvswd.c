@@ -7,184 +7,304 @@
 #include "rvswd.h"
 #include <inttypes.h>
 #include <stdint.h>
-#include "rom/ets_sys.h"
+#include "freertos/task.h"
+#include "rvswd_frame.h"
+#include "rvswd_stats.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#include <unistd.h>
+#else
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#endif
+
+#define RVSWD_REG_DATA0        0x04  // First of the twelve data registers
+#define RVSWD_REG_ABSTRACTAUTO 0x18  // Repeats the abstract command on data and program buffer accesses
+#define RVSWD_REG_PROGBUF0     0x20  // First of the sixteen program buffer registers
+
+// Clock frequencies tried by rvswd_tune_clock and stepped through after parity errors, fastest first
+static uint32_t const rvswd_clock_steps[] = {0, 8000000, 4000000, 2000000, 1000000, 500000, 200000, RVSWD_CLOCK_MIN_HZ};
+
+#define RVSWD_CLOCK_STEPS (sizeof(rvswd_clock_steps) / sizeof(rvswd_clock_steps[0]))
+
+// The lock is created on first use, which happens before the handle is shared
+static void rvswd_lock_create(rvswd_handle_t* handle) {
+    if (handle->lock == NULL) {
+        handle->lock = xSemaphoreCreateRecursiveMutexStatic(&handle->lock_buffer);
+    }
+}
 
 rvswd_result_t rvswd_init(rvswd_handle_t* handle) {
-    gpio_config_t swio_cfg = {
-        .pin_bit_mask = BIT64(handle->swdio),
-        .mode = GPIO_MODE_INPUT_OUTPUT_OD,
-        .pull_up_en = true,
-        .pull_down_en = false,
-        .intr_type = GPIO_INTR_DISABLE,
-    };
-    esp_err_t res = gpio_config(&swio_cfg);
-    if (res != ESP_OK) {
-        return RVSWD_FAIL;
-    }
-
-    gpio_config_t swck_cfg = {
-        .pin_bit_mask = BIT64(handle->swclk),
-        .mode = GPIO_MODE_OUTPUT,
-        .pull_up_en = false,
-        .pull_down_en = false,
-        .intr_type = GPIO_INTR_DISABLE,
-    };
-    res = gpio_config(&swck_cfg);
-    if (res != ESP_OK) {
-        return RVSWD_FAIL;
+    if (handle->transport == NULL) {
+#if CONFIG_IDF_TARGET_LINUX
+        return RVSWD_INVALID_ARGS;
+#else
+        handle->transport = &rvswd_transport_gpio;
+#endif
     }
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    rvswd_cache_invalidate(handle);
+    handle->abstractauto = 0xFFFFFFFF;  // Unknown until written, an earlier session may have left it set
 
-    return RVSWD_OK;
+    rvswd_result_t res = handle->transport->init(handle);
+    if (res == RVSWD_OK) {
+        res = rvswd_set_clock(handle, handle->clock_hz);
+    }
+    rvswd_unlock(handle);
+    return res;
 }
 
 rvswd_result_t rvswd_start(rvswd_handle_t* handle) {
-    // Start with both lines high
-    gpio_set_level(handle->swdio, true);
-    gpio_set_level(handle->swclk, true);
-    ets_delay_us(2);
-
-    // Pull data low
-    gpio_set_level(handle->swdio, false);
-    gpio_set_level(handle->swclk, true);
-    ets_delay_us(1);
-
-    // Pull clock low
-    gpio_set_level(handle->swdio, false);
-    gpio_set_level(handle->swclk, false);
-    ets_delay_us(1);
+    handle->transport->start(handle);
     return RVSWD_OK;
 }
 
 rvswd_result_t rvswd_stop(rvswd_handle_t* handle) {
-    // Pull data low
-    gpio_set_level(handle->swdio, false);
-    ets_delay_us(1);
-    gpio_set_level(handle->swclk, true);
-    ets_delay_us(2);
-    // Let data float high
-    gpio_set_level(handle->swdio, true);
-    ets_delay_us(1);
+    handle->transport->stop(handle);
     return RVSWD_OK;
 }
 
 rvswd_result_t rvswd_reset(rvswd_handle_t* handle) {
-    gpio_set_level(handle->swdio, true);
-    ets_delay_us(1);
-    for (uint8_t i = 0; i < 100; i++) {
-        gpio_set_level(handle->swclk, false);
-        ets_delay_us(1);
-        gpio_set_level(handle->swclk, true);
-        ets_delay_us(1);
-    }
-    return rvswd_stop(handle);
+    rvswd_cache_invalidate(handle);
+    handle->transport->reset(handle);
+    return RVSWD_OK;
 }
 
 void rvswd_write_bit(rvswd_handle_t* handle, bool value) {
-    gpio_set_level(handle->swdio, value);
-    gpio_set_level(handle->swclk, false);
-    gpio_set_level(handle->swclk, true);  // Data is sampled on rising edge of clock
+    handle->transport->write_bits(handle, value, 1);
 }
 
 bool rvswd_read_bit(rvswd_handle_t* handle) {
-    gpio_set_level(handle->swdio, true);
-    gpio_set_level(handle->swclk, false);
-    gpio_set_level(handle->swclk, true);  // Data is output on rising edge of clock
-    return gpio_get_level(handle->swdio);
+    return handle->transport->read_bits(handle, 1);
 }
 
 rvswd_result_t rvswd_write(rvswd_handle_t* handle, uint8_t reg, uint32_t value) {
-    rvswd_start(handle);
-
-    // ADDR HOST
-    bool parity = false;  // This time it's odd parity?
-    for (uint8_t position = 0; position < 7; position++) {
-        bool bit = (reg >> (6 - position)) & 1;
-        rvswd_write_bit(handle, bit);
-        if (bit) parity = !parity;
+    rvswd_transport_t const* transport = handle->transport;
+    if (reg == RVSWD_REG_ABSTRACTAUTO) {
+        handle->abstractauto = value;
+    }
+    RVSWD_STATS_COUNT(handle, frames_written);
+    if (transport->write_frame) {
+        return transport->write_frame(handle, reg, value);
     }
 
-    // Operation: write
-    rvswd_write_bit(handle, true);
-    parity = !parity;
-
-    // Parity bit (even)
-    rvswd_write_bit(handle, parity);
+    transport->start(handle);
+    transport->write_bits(handle, rvswd_frame_header(reg, true), RVSWD_FRAME_HEADER_BITS);
+    transport->write_bits(handle, value, 32);
+    transport->write_bits(handle, rvswd_frame_trailer(value), 6);
+    transport->stop(handle);
 
-    rvswd_write_bit(handle, 1);
-    rvswd_write_bit(handle, 0);
-    rvswd_write_bit(handle, 1);
-    rvswd_write_bit(handle, 0);
-    rvswd_write_bit(handle, 1);
+    return RVSWD_OK;
+}
 
-    // Data
-    parity = false;  // This time it's even parity?
-    for (uint8_t position = 0; position < 32; position++) {
-        bool bit = (value >> (31 - position)) & 1;
-        rvswd_write_bit(handle, bit);
-        if (bit) parity = !parity;
+static rvswd_result_t rvswd_read_frame(rvswd_handle_t* handle, uint8_t reg, uint32_t* value) {
+    rvswd_transport_t const* transport = handle->transport;
+    RVSWD_STATS_COUNT(handle, frames_read);
+    if (transport->read_frame) {
+        return transport->read_frame(handle, reg, value);
     }
 
-    // Parity bit
-    rvswd_write_bit(handle, parity);
+    transport->start(handle);
+    transport->write_bits(handle, rvswd_frame_header(reg, false), RVSWD_FRAME_HEADER_BITS);
+    *value = transport->read_bits(handle, 32);
+    bool parity = transport->read_bits(handle, 1);
+    transport->write_bits(handle, RVSWD_FRAME_DATA_TRAILER, RVSWD_FRAME_TRAILER_BITS);
+    transport->stop(handle);
 
-    rvswd_write_bit(handle, 1);
-    rvswd_write_bit(handle, 0);
-    rvswd_write_bit(handle, 1);
-    rvswd_write_bit(handle, 1);
-    rvswd_write_bit(handle, 1);
+    return rvswd_frame_check(*value, parity);
+}
 
-    rvswd_stop(handle);
+// Reading a data or program buffer register selected in ABSTRACTAUTO runs the abstract command again
+static bool rvswd_read_repeatable(rvswd_handle_t* handle, uint8_t reg) {
+    if (reg >= RVSWD_REG_DATA0 && reg < RVSWD_REG_DATA0 + 12) {
+        return !(handle->abstractauto & (1UL << (reg - RVSWD_REG_DATA0)));
+    }
+    if (reg >= RVSWD_REG_PROGBUF0 && reg < RVSWD_REG_PROGBUF0 + 16) {
+        return !(handle->abstractauto & (1UL << (16 + reg - RVSWD_REG_PROGBUF0)));
+    }
+    return true;
+}
 
+// Lower the clock to the next step below the current frequency, keeps the slowest step
+static rvswd_result_t rvswd_slow_down(rvswd_handle_t* handle) {
+    for (size_t i = 1; i < RVSWD_CLOCK_STEPS; i++) {
+        if (handle->clock_hz == 0 || rvswd_clock_steps[i] < handle->clock_hz) {
+            handle->errors.slowdowns++;
+            return rvswd_set_clock(handle, rvswd_clock_steps[i]);
+        }
+    }
     return RVSWD_OK;
 }
 
 rvswd_result_t rvswd_read(rvswd_handle_t* handle, uint8_t reg, uint32_t* value) {
-    bool parity;
+    rvswd_result_t res = rvswd_read_frame(handle, reg, value);
+    for (uint8_t retry = 0; res == RVSWD_PARITY_ERROR; retry++) {
+        handle->errors.parity++;
+        // A single error is taken as noise, an error that repeats means the clock is too fast for the wiring
+        bool repeatable = rvswd_read_repeatable(handle, reg);
+        if (retry > 0 || !repeatable) {
+            rvswd_result_t clock_res = rvswd_slow_down(handle);
+            if (clock_res != RVSWD_OK) {
+                return clock_res;
+            }
+        }
+        if (retry == RVSWD_READ_RETRIES || !repeatable) {
+            break;
+        }
+        handle->errors.retries++;
+        res = rvswd_read_frame(handle, reg, value);
+    }
+    return res;
+}
 
-    rvswd_start(handle);
+rvswd_result_t rvswd_set_clock(rvswd_handle_t* handle, uint32_t clock_hz) {
+    handle->clock_hz = clock_hz;
+    handle->clock_cycles = 0;
+#if !CONFIG_IDF_TARGET_LINUX
+    if (clock_hz) {
+        handle->clock_cycles = esp_rom_get_cpu_ticks_per_us() * 500000 / clock_hz;
+    }
+#endif
+    if (handle->transport->set_clock) {
+        return handle->transport->set_clock(handle);
+    }
+    return RVSWD_OK;
+}
 
-    // ADDR HOST
-    parity = false;
-    for (uint8_t position = 0; position < 7; position++) {
-        bool bit = (reg >> (6 - position)) & 1;
-        rvswd_write_bit(handle, bit);
-        if (bit) parity = !parity;
+static bool rvswd_loopback(rvswd_handle_t* handle, uint8_t reg) {
+    static uint32_t const patterns[] = {0x00000000, 0xFFFFFFFF, 0xAAAAAAAA, 0x55555555, 0x0F1E2D3C, 0xC3B4A596};
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+        uint32_t value;
+        if (rvswd_write(handle, reg, patterns[i]) != RVSWD_OK || rvswd_read_frame(handle, reg, &value) != RVSWD_OK ||
+            value != patterns[i]) {
+            return false;
+        }
     }
+    return true;
+}
 
-    // Operation: read
-    rvswd_write_bit(handle, false);
+rvswd_result_t rvswd_tune_clock(rvswd_handle_t* handle, uint8_t reg) {
+    for (size_t i = 0; i < RVSWD_CLOCK_STEPS; i++) {
+        rvswd_result_t res = rvswd_set_clock(handle, rvswd_clock_steps[i]);
+        if (res != RVSWD_OK) {
+            return res;
+        }
+        if (rvswd_loopback(handle, reg)) {
+            handle->clock_tuned = true;
+            return RVSWD_OK;
+        }
+    }
+    return RVSWD_FAIL;
+}
 
-    // Parity bit (even)
-    rvswd_write_bit(handle, parity);
+void rvswd_cache_invalidate(rvswd_handle_t* handle) {
+    handle->cache.progbuf_valid = 0;
+    handle->cache.gpr_valid = 0;
+}
 
-    rvswd_write_bit(handle, 1);
-    rvswd_write_bit(handle, 0);
-    rvswd_write_bit(handle, 1);
-    rvswd_write_bit(handle, 0);
-    rvswd_write_bit(handle, 1);
+void rvswd_delay_us(rvswd_handle_t* handle, uint32_t us) {
+    if (handle->transport->delay_us) {
+        handle->transport->delay_us(handle, us);
+        return;
+    }
+#if CONFIG_IDF_TARGET_LINUX
+    usleep(us);
+#else
+    esp_rom_delay_us(us);
+#endif
+}
 
-    *value = 0;
+static int64_t rvswd_system_time_us(void) {
+#if CONFIG_IDF_TARGET_LINUX
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#else
+    return esp_timer_get_time();
+#endif
+}
+
+int64_t rvswd_time_us(rvswd_handle_t* handle) {
+    if (handle->transport->time_us) {
+        return handle->transport->time_us(handle);
+    }
+    return rvswd_system_time_us();
+}
 
-    // Data
-    parity = false;
-    for (uint8_t position = 0; position < 32; position++) {
-        bool bit = rvswd_read_bit(handle);
-        if (bit) {
-            *value |= 1 << (31 - position);
+// The counters of the lock are only changed by the task holding it, except for the waiters and timeouts which are
+// changed by tasks that do not
+rvswd_result_t rvswd_lock(rvswd_handle_t* handle, uint32_t timeout_ms) {
+    rvswd_lock_create(handle);
+    rvswd_lock_stats_t* stats = &handle->lock_stats;
+    if (xSemaphoreTakeRecursive(handle->lock, 0) == pdTRUE) {
+        if (handle->lock_depth++ == 0) {
+            stats->acquired++;
         }
-        if (bit) parity = !parity;
+        return RVSWD_OK;
+    }
+
+    // The system timer is used, the time base of the transport belongs to the task holding the lock
+    int64_t start = rvswd_system_time_us();
+    TickType_t ticks = timeout_ms == RVSWD_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    __atomic_add_fetch(&handle->lock_waiters, 1, __ATOMIC_RELAXED);
+    BaseType_t taken = xSemaphoreTakeRecursive(handle->lock, ticks);
+    __atomic_sub_fetch(&handle->lock_waiters, 1, __ATOMIC_RELAXED);
+    if (taken != pdTRUE) {
+        __atomic_add_fetch(&stats->timeouts, 1, __ATOMIC_RELAXED);
+        return RVSWD_TIMEOUT;
     }
 
-    // Parity bit
-    bool parity_read = rvswd_read_bit(handle);
+    uint32_t wait_us = rvswd_system_time_us() - start;
+    handle->lock_depth = 1;
+    stats->acquired++;
+    stats->contended++;
+    stats->wait_us += wait_us;
+    if (wait_us > stats->max_wait_us) {
+        stats->max_wait_us = wait_us;
+    }
+    return RVSWD_OK;
+}
 
-    rvswd_write_bit(handle, 1);
-    rvswd_write_bit(handle, 0);
-    rvswd_write_bit(handle, 1);
-    rvswd_write_bit(handle, 1);
-    rvswd_write_bit(handle, 1);
+void rvswd_unlock(rvswd_handle_t* handle) {
+    bool released = --handle->lock_depth == 0;
+    xSemaphoreGiveRecursive(handle->lock);
+    // Giving the mutex readies the task waiting for it, a waiter of a higher priority runs at once and one of the same
+    // priority gets the lock by yielding to it
+    if (released && rvswd_lock_waiting(handle)) {
+        taskYIELD();
+    }
+}
 
-    rvswd_stop(handle);
+bool rvswd_lock_waiting(rvswd_handle_t* handle) {
+    return __atomic_load_n(&handle->lock_waiters, __ATOMIC_RELAXED) != 0;
+}
 
-    return (parity == parity_read) ? RVSWD_OK : RVSWD_FAIL;
+void rvswd_backoff(rvswd_handle_t* handle, uint32_t* delay_us) {
+    if (*delay_us == 0) {
+        *delay_us = 1;
+        return;
+    }
+    rvswd_delay_us(handle, *delay_us);
+    if (*delay_us < RVSWD_POLL_MAX_DELAY_US) {
+        *delay_us *= 2;
+    }
+}
+
+rvswd_result_t rvswd_poll(rvswd_handle_t* handle, uint8_t reg, uint32_t mask, uint32_t expected, uint32_t timeout_us,
+                          uint32_t* value) {
+    int64_t deadline = rvswd_time_us(handle) + timeout_us;
+    uint32_t delay_us = 0;
+    while (1) {
+        RVSWD_STATS_COUNT(handle, polls);
+        rvswd_result_t res = rvswd_read(handle, reg, value);
+        if (res == RVSWD_OK && (*value & mask) == expected &&
+            (handle->transport->match == NULL || handle->transport->match(handle, mask, expected))) {
+            return RVSWD_OK;
+        }
+        if (rvswd_time_us(handle) > deadline) {
+            return res == RVSWD_OK ? RVSWD_TIMEOUT : res;
+        }
+        rvswd_backoff(handle, &delay_us);
+    }
 }
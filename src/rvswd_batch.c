@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "rvswd_batch.h"
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "rvswd.h"
+
+static portMUX_TYPE rvswd_batch_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+void rvswd_batch_init(rvswd_batch_t* batch, rvswd_batch_entry_t* entries, size_t capacity) {
+    batch->entries = entries;
+    batch->capacity = capacity;
+    batch->count = 0;
+}
+
+void rvswd_batch_clear(rvswd_batch_t* batch) {
+    batch->count = 0;
+}
+
+static rvswd_result_t rvswd_batch_add(rvswd_batch_t* batch, uint8_t reg, bool read, uint32_t value,
+                                      uint32_t* result) {
+    if (batch->count >= batch->capacity) {
+        return RVSWD_INVALID_ARGS;
+    }
+    batch->entries[batch->count++] = (rvswd_batch_entry_t){
+        .reg = reg,
+        .read = read,
+        .value = value,
+        .result = result,
+    };
+    return RVSWD_OK;
+}
+
+rvswd_result_t rvswd_batch_write(rvswd_batch_t* batch, uint8_t reg, uint32_t value) {
+    return rvswd_batch_add(batch, reg, false, value, NULL);
+}
+
+rvswd_result_t rvswd_batch_read(rvswd_batch_t* batch, uint8_t reg, uint32_t* result) {
+    return rvswd_batch_add(batch, reg, true, 0, result);
+}
+
+rvswd_result_t rvswd_batch_execute(rvswd_handle_t* handle, rvswd_batch_t* batch, size_t* failed_index) {
+    rvswd_result_t res = RVSWD_OK;
+    size_t index;
+
+    // Taken before the critical section, the lock may block
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+
+    // Transports that wait on a driver can not run with interrupts masked
+    bool atomic = !handle->transport->blocking;
+    if (atomic) {
+        portENTER_CRITICAL(&rvswd_batch_spinlock);
+    }
+
+    for (index = 0; index < batch->count; index++) {
+        rvswd_batch_entry_t* entry = &batch->entries[index];
+        if (entry->read) {
+            uint32_t value;
+            res = rvswd_read(handle, entry->reg, &value);
+            if (entry->result) {
+                *entry->result = value;
+            }
+        } else {
+            res = rvswd_write(handle, entry->reg, entry->value);
+        }
+        if (res != RVSWD_OK) {
+            break;
+        }
+    }
+
+    if (atomic) {
+        portEXIT_CRITICAL(&rvswd_batch_spinlock);
+    }
+    rvswd_unlock(handle);
+
+    if (res != RVSWD_OK && failed_index) {
+        *failed_index = index;
+    }
+    return res;
+}
@@ -0,0 +1,41 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "rvswd_ch32.h"
+#include <inttypes.h>
+#include <stddef.h>
+#include "esp_log.h"
+#include "rvswd_ch32v20x.h"
+
+static char const TAG[] = "CH32";
+
+static ch32_family_t const* const ch32_families[] = {
+    &ch32_family_ch32v20x,
+    &ch32_family_ch32x035,
+};
+
+ch32_family_t const* ch32_family_detect(rvswd_handle_t* handle) {
+    uint32_t chip_id = 0;
+    if (!ch32v20x_read_memory_word(handle, CH32_ADDR_CHIP_ID, &chip_id)) {
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(ch32_families) / sizeof(ch32_families[0]); i++) {
+        if ((chip_id & ch32_families[i]->chip_id_mask) == ch32_families[i]->chip_id) {
+            ESP_LOGI(TAG, "Chip ID %08" PRIx32 ", %s", chip_id, ch32_families[i]->name);
+            return ch32_families[i];
+        }
+    }
+    ESP_LOGW(TAG, "Chip ID %08" PRIx32 " does not belong to a supported family", chip_id);
+    return NULL;
+}
+
+ch32_family_t const* ch32_family(rvswd_handle_t* handle) {
+    // Callers halting the target themselves instead of attaching get the family on first use
+    if (handle->target == NULL) {
+        handle->target = ch32_family_detect(handle);
+    }
+    return handle->target;
+}
@@ -8,7 +8,13 @@
 #include "rvswd_ch32v20x.h"
 #include "ch32v20x_registers.h"
 #include "esp_log.h"
+#include "esp_rom_crc.h"
 #include "freertos/projdefs.h"
+#include "rvswd_batch.h"
+#include "rvswd_ch32.h"
+#include "rvswd_gang.h"
+#include "rvswd_source.h"
+#include "rvswd_stats.h"
 #include "string.h"
 
 static char const TAG[] = "CH32V20X";
@@ -41,122 +47,310 @@ static char const TAG[] = "CH32V20X";
 #define CH32_CFGR_OUTEN (1 << 10)
 
 #define CH32_CODE_BEGIN 0x08000000  // The start of CH32 CODE Flash region
-#define CH32_CODE_END   0x08004000  // the end of the CH32 CODE Flash region
 
 #define CH32V20X_FLASH_STATR 0x4002200C  // Flash status register
 #define CH32V20X_FLASH_CTLR  0x40022010  // Flash configuration register
 #define CH32_FLASH_ADDR      0x40022014  // Flash address register
 
-static uint8_t const ch32v20x_readmem[] = {0x88, 0x41, 0x02, 0x90};
-static uint8_t const ch32v20x_writemem[] = {0x88, 0xc1, 0x02, 0x90};
+// Declare a batch with storage for the given number of transactions on the stack, plus the ABSTRACTCS read added by
+// ch32v20x_execute
+#define CH32V20X_BATCH(name, size)                  \
+    rvswd_batch_entry_t name##_entries[(size) + 1]; \
+    rvswd_batch_t name;                             \
+    rvswd_batch_init(&name, name##_entries, (size) + 1)
+
+#define CH32V20X_BLOCK_CHUNK   32  // Words transferred per batch by the block functions
+#define CH32V20X_ATTEMPTS      3   // Attempts of a register, word or block access before its failure is passed on
+#define CH32V20X_PAGE_ATTEMPTS 3   // Attempts of erasing, programming and verifying a page
+
+#define CH32V20X_ABSTRACTCS_CMDERR (7 << 8)  // Error of the last abstract command, cleared by writing ones
+
+#define CH32V20X_FLASH_TIMEOUT_US 500000  // Longest flash operation, a mass erase
+
+#define CH32V20X_LOADER_ADDR   0x20000000  // Flash loader code in SRAM
+#define CH32V20X_CRC32_ADDR    0x20000100  // CRC32 code in SRAM
+#define CH32V20X_LOADER_BUFFER 0x20000400  // Page buffer of the flash loader
+#define CH32V20X_PAGE_SIZE     256         // Size of a fast programming page
+#define CH32V20X_SECTOR_SIZE   4096        // Size of a standard erase sector
+#define CH32V20X_MAX_PAGES     2048        // Pages in the largest flash of any family, 512K
+
+#define CH32V20X_FINGERPRINT_MAGIC 0x50465752  // "RWFP", marks the fingerprint in the last flash page
+
+// Stored at the start of the last flash page to describe the image programmed at the start of flash
+typedef struct ch32v20x_fingerprint {
+    uint32_t magic;
+    uint32_t length;
+    uint32_t crc;
+    uint32_t crc_inverted;
+} ch32v20x_fingerprint_t;
+
+// c.lw a0, 0(a1); c.addi a1, 4; c.ebreak
+static uint8_t const ch32v20x_readmem_increment[] = {0x88, 0x41, 0x91, 0x05, 0x02, 0x90, 0x00, 0x00};
+// c.sw a0, 0(a1); c.addi a1, 4; c.ebreak
+static uint8_t const ch32v20x_writemem_increment[] = {0x88, 0xc1, 0x91, 0x05, 0x02, 0x90, 0x00, 0x00};
+// c.jalr t1; c.ebreak
+static uint8_t const ch32v20x_call_stub_program[] = {0x02, 0x93, 0x02, 0x90};
+
+#define CH32V20X_GPR(n)         (1UL << (n))  // Bit of register xn in the cache and clobber masks
+#define CH32V20X_GPR_ALL        0xFFFFFFFF    // Every general purpose register
+#define CH32V20X_LOADER_CLOBBER 0x00008CA0    // Registers changed by the flash loader: t0, t2, a0, a1 and a5
+#define CH32V20X_CRC32_CLOBBER  0x00003CA0    // Registers changed by the CRC32 stub: t0, t2 and a0 to a3
+
+// Flash loader, programs the erased page at a2 with the 256 bytes at a3, returns FLASH_STATR in a0
+static uint32_t const ch32v20x_flash_loader[] = {
+    0x400227b7,  // lui a5, 0x40022
+    0x000102b7,  // lui t0, 0x10            (FTPG)
+    0x0057a823,  // sw t0, 0x10(a5)         (CTLR)
+    0x00c7aa23,  // sw a2, 0x14(a5)         (ADDR)
+    0x00060513,  // mv a0, a2
+    0x00068593,  // mv a1, a3
+    0x04000393,  // li t2, 64
+    0x0005a283,  // copy: lw t0, 0(a1)
+    0x00552023,  // sw t0, 0(a0)
+    0x00c7a283,  // write_wait: lw t0, 0x0c(a5)
+    0x0022f293,  // andi t0, t0, 2          (WRBUSY)
+    0xfe029ce3,  // bnez t0, write_wait
+    0x00450513,  // addi a0, a0, 4
+    0x00458593,  // addi a1, a1, 4
+    0xfff38393,  // addi t2, t2, -1
+    0xfe0390e3,  // bnez t2, copy
+    0x002102b7,  // lui t0, 0x210           (FTPG | PGSTRT)
+    0x0057a823,  // sw t0, 0x10(a5)
+    0x00c7a283,  // program_wait: lw t0, 0x0c(a5)
+    0x0012f293,  // andi t0, t0, 1          (BSY)
+    0xfe029ce3,  // bnez t0, program_wait
+    0x00c7a503,  // lw a0, 0x0c(a5)
+    0x00a7a623,  // sw a0, 0x0c(a5)         (clear EOP and WRPRTERR)
+    0x0007a823,  // sw zero, 0x10(a5)
+    0x00008067,  // ret
+};
+
+// CRC32 (IEEE 802.3) of the a3 bytes at a2, returned in a0
+static uint32_t const ch32v20x_crc32_stub[] = {
+    0xfff00513,  // li a0, -1
+    0xedb883b7,  // lui t2, 0xedb88
+    0x32038393,  // addi t2, t2, 0x320      (polynomial)
+    0x02068a63,  // beqz a3, done
+    0x00064283,  // byte: lbu t0, 0(a2)
+    0x00554533,  // xor a0, a0, t0
+    0x00800593,  // li a1, 8
+    0x00157293,  // bit: andi t0, a0, 1
+    0x00155513,  // srli a0, a0, 1
+    0x00028463,  // beqz t0, skip
+    0x00754533,  // xor a0, a0, t2
+    0xfff58593,  // skip: addi a1, a1, -1
+    0xfe0596e3,  // bnez a1, bit
+    0x00160613,  // addi a2, a2, 1
+    0xfff68693,  // addi a3, a3, -1
+    0xfc069ae3,  // bnez a3, byte
+    0xfff54513,  // done: not a0, a0
+    0x00008067,  // ret
+};
+
+// Count another attempt of a failed access, returns whether it is to be repeated. Every access is built again from
+// the cleared cache, so a repeat does not rely on the state the failed attempt left behind.
+static bool ch32v20x_retry(rvswd_handle_t* handle, uint8_t* attempt) {
+    if (++*attempt >= CH32V20X_ATTEMPTS) {
+        return false;
+    }
+    handle->errors.repeats++;
+    return true;
+}
 
-rvswd_result_t ch32v20x_halt_microprocessor(rvswd_handle_t* handle) {
-    rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x80000001);  // Make the debug module work properly
-    rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x80000001);  // Initiate a halt request
+static uint32_t ch32v20x_timeout_us(rvswd_handle_t* handle) {
+    return handle->timeout_us ? handle->timeout_us : RVSWD_DEFAULT_TIMEOUT_US;
+}
 
-    // Get the debug module status information, check rdata[9:8], if the value is 0b11,
-    // it means the processor enters the halt state normally. Otherwise try again.
-    uint8_t timeout = 5;
-    while (1) {
-        uint32_t value;
-        rvswd_read(handle, CH32_REG_DEBUG_DMSTATUS, &value);
-        if (((value >> 8) & 0b11) == 0b11) {  // Check that processor has entered halted state
-            break;
-        }
-        if (timeout == 0) {
-            ESP_LOGE(TAG, "Failed to halt microprocessor, DMSTATUS=%" PRIx32, value);
-            return false;
+// Set up the debug module so that DATA0 accesses do not start abstract commands and pick the fastest clock the wiring
+// allows, unless the handle already has a tuned or fixed clock. The set up is done at the slowest clock when tuning.
+static rvswd_result_t ch32v20x_connect_locked(rvswd_handle_t* handle) {
+    bool tune = !handle->clock_tuned && handle->clock_hz == 0;
+    rvswd_result_t res;
+    if (tune) {
+        res = rvswd_set_clock(handle, RVSWD_CLOCK_MIN_HZ);
+        if (res != RVSWD_OK) {
+            return res;
         }
-        timeout--;
-        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x00000001);  // Activate the debug module
+    rvswd_write(handle, CH32_REG_DEBUG_ABSTRACTAUTO, 0);
+    rvswd_write(handle, CH32_REG_DEBUG_ABSTRACTCS, CH32V20X_ABSTRACTCS_CMDERR);  // Commands are refused while set
+    if (!tune) {
+        return RVSWD_OK;
+    }
+
+    res = rvswd_tune_clock(handle, CH32_REG_DEBUG_DATA0);
+    if (res != RVSWD_OK) {
+        return res;
+    }
+    if (handle->clock_hz) {
+        ESP_LOGI(TAG, "Clock limited to %" PRIu32 " Hz", handle->clock_hz);
+    }
+    return RVSWD_OK;
+}
+
+rvswd_result_t ch32v20x_connect(rvswd_handle_t* handle) {
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    rvswd_result_t res = ch32v20x_connect_locked(handle);
+    rvswd_unlock(handle);
+    return res;
+}
+
+static rvswd_result_t ch32v20x_halt_microprocessor_locked(rvswd_handle_t* handle) {
+    rvswd_cache_invalidate(handle);  // The registers are unknown until the core is halted
+    RVSWD_STATS_START(handle, start);
+    uint32_t value = 0;
+    rvswd_result_t res;
+    uint8_t attempt = 0;
+    do {
+        rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x80000001);  // Make the debug module work properly
+        rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x80000001);  // Initiate a halt request
+
+        // Get the debug module status information, check rdata[10:9], allhalted set and anyrunning clear means the
+        // processor enters the halt state normally. Unlike anyhalted, anyrunning also holds when a gang transport
+        // combines the status of several targets. Writes are not acknowledged, the request is sent again when the
+        // state does not change.
+        res = rvswd_poll(handle, CH32_REG_DEBUG_DMSTATUS, 0b11 << 9, 0b01 << 9, ch32v20x_timeout_us(handle), &value);
+    } while (res != RVSWD_OK && ch32v20x_retry(handle, &attempt));
+    if (res != RVSWD_OK) {
+        ESP_LOGE(TAG, "Failed to halt microprocessor, DMSTATUS=%" PRIx32, value);
+        return res;
     }
 
     rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x00000001);  // Clear the halt request
+    handle->target_state |= CH32_STATE_HALTED;
+    RVSWD_STATS_STOP(handle, RVSWD_STATS_HALT, start);
     ESP_LOGI(TAG, "Microprocessor halted");
     return RVSWD_OK;
 }
 
-rvswd_result_t ch32v20x_resume_microprocessor(rvswd_handle_t* handle) {
-    rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x80000001);  // Make the debug module work properly
-    rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x80000001);  // Initiate a halt request
-    rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x00000001);  // Clear the halt request
-    rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x40000001);  // Initiate a resume request
+rvswd_result_t ch32v20x_halt_microprocessor(rvswd_handle_t* handle) {
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    rvswd_result_t res = ch32v20x_halt_microprocessor_locked(handle);
+    rvswd_unlock(handle);
+    return res;
+}
 
-    // Get the debug module status information, check rdata[17:16],
-    // if the value is 0b11, it means the processor has recovered.
-    uint8_t timeout = 5;
-    while (1) {
-        uint32_t value;
-        rvswd_read(handle, CH32_REG_DEBUG_DMSTATUS, &value);
-        if ((((value >> 10) & 0b11) == 0b11)) {
-            break;
-        }
-        if (timeout == 0) {
-            ESP_LOGE(TAG, "Failed to resume microprocessor, DMSTATUS=%" PRIx32, value);
-            return RVSWD_FAIL;
-        }
-        timeout--;
-        vTaskDelay(pdMS_TO_TICKS(10));
+static rvswd_result_t ch32v20x_resume_microprocessor_locked(rvswd_handle_t* handle) {
+    rvswd_cache_invalidate(handle);           // The core may change registers while it runs
+    handle->target_state &= CH32_STATE_OPEN;  // And SRAM and the flash controller
+    uint32_t value = 0;
+    rvswd_result_t res;
+    uint8_t attempt = 0;
+    do {
+        rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x80000001);  // Make the debug module work properly
+        rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x80000001);  // Initiate a halt request
+        rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x00000001);  // Clear the halt request
+        rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x40000001);  // Initiate a resume request
+
+        // Get the debug module status information, allrunning set and anyhalted clear means the processor is running.
+        res = rvswd_poll(handle, CH32_REG_DEBUG_DMSTATUS, (1 << 11) | (1 << 8), 1 << 11, ch32v20x_timeout_us(handle),
+                         &value);
+    } while (res != RVSWD_OK && ch32v20x_retry(handle, &attempt));
+    if (res != RVSWD_OK) {
+        ESP_LOGE(TAG, "Failed to resume microprocessor, DMSTATUS=%" PRIx32, value);
+        return res;
     }
     return RVSWD_OK;
 }
 
-rvswd_result_t ch32v20x_reset_microprocessor_and_run(rvswd_handle_t* handle) {
-    rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x80000001);  // Make the debug module work properly
-    rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x80000001);  // Initiate a halt request
-    rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x00000001);  // Clear the halt request
-    rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x00000003);  // Initiate a core reset request
+rvswd_result_t ch32v20x_resume_microprocessor(rvswd_handle_t* handle) {
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    rvswd_result_t res = ch32v20x_resume_microprocessor_locked(handle);
+    rvswd_unlock(handle);
+    return res;
+}
 
-    uint8_t timeout = 5;
-    while (1) {
-        uint32_t value;
-        rvswd_read(handle, CH32_REG_DEBUG_DMSTATUS, &value);
-        if (((value >> 18) & 0b11) == 0b11) {  // Check that processor has been reset
-            break;
-        }
-        if (timeout == 0) {
-            ESP_LOGE(TAG, "Failed to reset microprocessor");
-            return RVSWD_FAIL;
-        }
-        timeout--;
-        vTaskDelay(pdMS_TO_TICKS(10));
+static rvswd_result_t ch32v20x_reset_microprocessor_and_run_locked(rvswd_handle_t* handle) {
+    rvswd_cache_invalidate(handle);           // The core may change registers while it runs
+    handle->target_state &= CH32_STATE_OPEN;  // And SRAM, the reset locks the flash as well
+    uint32_t value = 0;
+    rvswd_result_t res;
+    uint8_t attempt = 0;
+    do {
+        rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x80000001);  // Make the debug module work properly
+        rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x80000001);  // Initiate a halt request
+        rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x00000001);  // Clear the halt request
+        rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x00000003);  // Initiate a core reset request
+
+        // Check rdata[19:18], if the value is 0b11 the processor has been reset
+        res = rvswd_poll(handle, CH32_REG_DEBUG_DMSTATUS, 0b11 << 18, 0b11 << 18, ch32v20x_timeout_us(handle), &value);
+    } while (res != RVSWD_OK && ch32v20x_retry(handle, &attempt));
+    if (res != RVSWD_OK) {
+        ESP_LOGE(TAG, "Failed to reset microprocessor, DMSTATUS=%" PRIx32, value);
+        return res;
     }
 
     rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x00000001);  // Clear the core reset request
-    vTaskDelay(pdMS_TO_TICKS(10));
     rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x10000001);  // Clear the core reset status signal
-    vTaskDelay(pdMS_TO_TICKS(10));
     rvswd_write(handle, CH32_REG_DEBUG_DMCONTROL, 0x00000001);  // Clear the core reset status signal clear request
-    vTaskDelay(pdMS_TO_TICKS(10));
 
     return RVSWD_OK;
 }
 
-bool ch32v20x_write_cpu_reg(rvswd_handle_t* handle, uint16_t regno, uint32_t value) {
+rvswd_result_t ch32v20x_reset_microprocessor_and_run(rvswd_handle_t* handle) {
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    rvswd_result_t res = ch32v20x_reset_microprocessor_and_run_locked(handle);
+    rvswd_unlock(handle);
+    return res;
+}
+
+// Write a register through the abstract command, skipped when the cache shows it already holds the value
+static void ch32v20x_batch_write_cpu_reg(rvswd_handle_t* handle, rvswd_batch_t* batch, uint16_t regno, uint32_t value) {
+    rvswd_cache_t* cache = &handle->cache;
+    if (regno >= CH32_REGS_GPR && regno < CH32_REGS_GPR + 32) {
+        uint32_t bit = 1UL << (regno - CH32_REGS_GPR);
+        if ((cache->gpr_valid & bit) && cache->gpr[regno - CH32_REGS_GPR] == value) {
+            cache->hits++;
+            return;
+        }
+        cache->misses++;
+        cache->gpr[regno - CH32_REGS_GPR] = value;
+        cache->gpr_valid |= bit;
+    }
+
     uint32_t command = regno         // Register to access.
                        | (1 << 16)   // Write access.
                        | (1 << 17)   // Perform transfer.
                        | (2 << 20)   // 32-bit register access.
                        | (0 << 24);  // Access register command.
 
-    rvswd_write(handle, CH32_REG_DEBUG_DATA0, value);
-    rvswd_write(handle, CH32_REG_DEBUG_COMMAND, command);
-    return true;
+    rvswd_batch_write(batch, CH32_REG_DEBUG_DATA0, value);
+    rvswd_batch_write(batch, CH32_REG_DEBUG_COMMAND, command);
 }
 
-bool ch32v20x_read_cpu_reg(rvswd_handle_t* handle, uint16_t regno, uint32_t* value_out) {
+static void ch32v20x_batch_read_cpu_reg(rvswd_batch_t* batch, uint16_t regno, uint32_t* value_out) {
     uint32_t command = regno         // Register to access.
                        | (0 << 16)   // Read access.
                        | (1 << 17)   // Perform transfer.
                        | (2 << 20)   // 32-bit register access.
                        | (0 << 24);  // Access register command.
 
-    rvswd_write(handle, CH32_REG_DEBUG_COMMAND, command);
-    rvswd_read(handle, CH32_REG_DEBUG_DATA0, value_out);
-    return true;
+    rvswd_batch_write(batch, CH32_REG_DEBUG_COMMAND, command);
+    rvswd_batch_read(batch, CH32_REG_DEBUG_DATA0, value_out);
 }
 
-bool ch32v20x_run_debug_code(rvswd_handle_t* handle, void const* code, size_t code_size) {
+// Write a program buffer register, skipped when the cache shows it already holds the value
+static void ch32v20x_batch_write_progbuf(rvswd_handle_t* handle, rvswd_batch_t* batch, size_t index, uint32_t value) {
+    rvswd_cache_t* cache = &handle->cache;
+    uint32_t bit = 1UL << index;
+    if ((cache->progbuf_valid & bit) && cache->progbuf[index] == value) {
+        cache->hits++;
+        return;
+    }
+    cache->misses++;
+    cache->progbuf[index] = value;
+    cache->progbuf_valid |= bit;
+    rvswd_batch_write(batch, CH32_REG_DEBUG_PROGBUF0 + index, value);
+}
+
+// Forget the registers a program run from the program buffer may have changed
+static void ch32v20x_cache_clobber(rvswd_handle_t* handle, uint32_t gprs) {
+    handle->cache.gpr_valid &= ~gprs;
+}
+
+static bool ch32v20x_batch_run_debug_code(rvswd_handle_t* handle, rvswd_batch_t* batch, void const* code,
+                                          size_t code_size) {
     if (code_size > 8 * 4) {
         ESP_LOGE(TAG, "Debug program is too long (%zd/%zd)", code_size, (size_t)8 * 4);
         return false;
@@ -169,7 +363,7 @@ bool ch32v20x_run_debug_code(rvswd_handle_t* handle, void const* code, size_t co
     uint32_t tmp[8] = {0};
     memcpy(tmp, code, code_size);
     for (size_t i = 0; i < 8; i++) {
-        rvswd_write(handle, CH32_REG_DEBUG_PROGBUF0 + i, tmp[i]);
+        ch32v20x_batch_write_progbuf(handle, batch, i, tmp[i]);
     }
 
     // Run program buffer.
@@ -177,77 +371,363 @@ bool ch32v20x_run_debug_code(rvswd_handle_t* handle, void const* code, size_t co
                        | (1 << 18)   // Run program buffer afterwards.
                        | (2 << 20)   // 32-bit register access.
                        | (0 << 24);  // Access register command.
-    rvswd_write(handle, CH32_REG_DEBUG_COMMAND, command);
+    rvswd_batch_write(batch, CH32_REG_DEBUG_COMMAND, command);
 
+    // Arbitrary code can change any register
+    ch32v20x_cache_clobber(handle, CH32V20X_GPR_ALL);
     return true;
 }
 
-bool ch32v20x_read_memory_word(rvswd_handle_t* handle, uint32_t address, uint32_t* value_out) {
-    ch32v20x_write_cpu_reg(handle, CH32_REGS_GPR + 11, address);
-    ch32v20x_run_debug_code(handle, ch32v20x_readmem, sizeof(ch32v20x_readmem));
-    ch32v20x_read_cpu_reg(handle, CH32_REGS_GPR + 10, value_out);
+// Load a program that only needs the first words of the program buffer, the words after its ebreak are left as is
+static void ch32v20x_batch_load_program(rvswd_handle_t* handle, rvswd_batch_t* batch, uint8_t const* code,
+                                        size_t code_size) {
+    for (size_t i = 0; i < code_size / 4; i++) {
+        uint32_t word;
+        memcpy(&word, &code[i * 4], sizeof(word));
+        ch32v20x_batch_write_progbuf(handle, batch, i, word);
+    }
+}
+
+// Run a batch followed by a read of ABSTRACTCS, an abstract command that failed in the batch fails the batch and its
+// error is cleared so that the next command is accepted
+static bool ch32v20x_execute(rvswd_handle_t* handle, rvswd_batch_t* batch) {
+    uint32_t abstractcs = 0;
+    rvswd_batch_read(batch, CH32_REG_DEBUG_ABSTRACTCS, &abstractcs);
+    size_t failed_index;
+    rvswd_result_t res = rvswd_batch_execute(handle, batch, &failed_index);
+    batch->count--;
+    if (res != RVSWD_OK) {
+        ESP_LOGE(TAG, "Transaction %zu of %zu failed (%u)", failed_index, batch->count, res);
+        // The cache was updated for transactions that never reached the target
+        rvswd_cache_invalidate(handle);
+        return false;
+    }
+    if (abstractcs & CH32V20X_ABSTRACTCS_CMDERR) {
+        ESP_LOGE(TAG, "Abstract command failed, ABSTRACTCS=%" PRIx32, abstractcs);
+        handle->errors.cmderr++;
+        rvswd_write(handle, CH32_REG_DEBUG_ABSTRACTCS, CH32V20X_ABSTRACTCS_CMDERR);
+        rvswd_cache_invalidate(handle);
+        return false;
+    }
     return true;
 }
 
+// The lock is held from building a batch until it ran, building it updates the cache
+bool ch32v20x_write_cpu_reg(rvswd_handle_t* handle, uint16_t regno, uint32_t value) {
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    bool res;
+    uint8_t attempt = 0;
+    do {
+        CH32V20X_BATCH(batch, 2);
+        ch32v20x_batch_write_cpu_reg(handle, &batch, regno, value);
+        res = ch32v20x_execute(handle, &batch);
+    } while (!res && ch32v20x_retry(handle, &attempt));
+    rvswd_unlock(handle);
+    return res;
+}
+
+bool ch32v20x_read_cpu_reg(rvswd_handle_t* handle, uint16_t regno, uint32_t* value_out) {
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    bool res;
+    uint8_t attempt = 0;
+    do {
+        CH32V20X_BATCH(batch, 2);
+        ch32v20x_batch_read_cpu_reg(&batch, regno, value_out);
+        res = ch32v20x_execute(handle, &batch);
+    } while (!res && ch32v20x_retry(handle, &attempt));
+    rvswd_unlock(handle);
+    return res;
+}
+
+bool ch32v20x_run_debug_code(rvswd_handle_t* handle, void const* code, size_t code_size) {
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    CH32V20X_BATCH(batch, 9);
+    bool res = ch32v20x_batch_run_debug_code(handle, &batch, code, code_size) && ch32v20x_execute(handle, &batch);
+    rvswd_unlock(handle);
+    return res;
+}
+
+// The word functions use the post-increment programs so that accessing the next word finds x11 already loaded
+static bool ch32v20x_read_memory_word_once(rvswd_handle_t* handle, uint32_t address, uint32_t* value_out) {
+    CH32V20X_BATCH(batch, 7);
+    ch32v20x_batch_write_cpu_reg(handle, &batch, CH32_REGS_GPR + 11, address);
+    ch32v20x_batch_load_program(handle, &batch, ch32v20x_readmem_increment, sizeof(ch32v20x_readmem_increment));
+    rvswd_batch_write(&batch, CH32_REG_DEBUG_COMMAND, (1 << 18) | (2 << 20));  // Run the program buffer
+    ch32v20x_batch_read_cpu_reg(&batch, CH32_REGS_GPR + 10, value_out);
+    ch32v20x_cache_clobber(handle, CH32V20X_GPR(10));
+    handle->cache.gpr[11] = address + 4;
+    return ch32v20x_execute(handle, &batch);
+}
+
+static bool ch32v20x_write_memory_word_once(rvswd_handle_t* handle, uint32_t address, uint32_t value) {
+    uint32_t command = (CH32_REGS_GPR + 10)  // Register to access.
+                       | (1 << 16)           // Write access.
+                       | (1 << 17)           // Perform transfer.
+                       | (1 << 18)           // Run program buffer afterwards.
+                       | (2 << 20)           // 32-bit register access.
+                       | (0 << 24);          // Access register command.
+
+    CH32V20X_BATCH(batch, 6);
+    ch32v20x_batch_write_cpu_reg(handle, &batch, CH32_REGS_GPR + 11, address);
+    ch32v20x_batch_load_program(handle, &batch, ch32v20x_writemem_increment, sizeof(ch32v20x_writemem_increment));
+    rvswd_batch_write(&batch, CH32_REG_DEBUG_DATA0, value);
+    rvswd_batch_write(&batch, CH32_REG_DEBUG_COMMAND, command);  // Move the value to x10 and store it
+    ch32v20x_cache_clobber(handle, CH32V20X_GPR(10));
+    handle->cache.gpr[11] = address + 4;
+    return ch32v20x_execute(handle, &batch);
+}
+
+bool ch32v20x_read_memory_word(rvswd_handle_t* handle, uint32_t address, uint32_t* value_out) {
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    bool res;
+    uint8_t attempt = 0;
+    do {
+        res = ch32v20x_read_memory_word_once(handle, address, value_out);
+    } while (!res && ch32v20x_retry(handle, &attempt));
+    rvswd_unlock(handle);
+    return res;
+}
+
+// Forget a stub when a write lands in the SRAM it occupies
+static inline void ch32v20x_stubs_clobber(rvswd_handle_t* handle, uint32_t address, size_t size) {
+    if (address < CH32V20X_CRC32_ADDR && address + size > CH32V20X_LOADER_ADDR) {
+        handle->target_state &= ~CH32_STATE_LOADER;
+    }
+    if (address < CH32V20X_LOADER_BUFFER && address + size > CH32V20X_CRC32_ADDR) {
+        handle->target_state &= ~CH32_STATE_CRC32;
+    }
+}
+
 bool ch32v20x_write_memory_word(rvswd_handle_t* handle, uint32_t address, uint32_t value) {
-    ch32v20x_write_cpu_reg(handle, CH32_REGS_GPR + 10, value);
-    ch32v20x_write_cpu_reg(handle, CH32_REGS_GPR + 11, address);
-    ch32v20x_run_debug_code(handle, ch32v20x_writemem, sizeof(ch32v20x_writemem));
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    ch32v20x_stubs_clobber(handle, address, 4);
+    bool res;
+    uint8_t attempt = 0;
+    do {
+        res = ch32v20x_write_memory_word_once(handle, address, value);
+    } while (!res && ch32v20x_retry(handle, &attempt));
+    rvswd_unlock(handle);
+    return res;
+}
+
+// Read count words starting at address. The program buffer is loaded once, after which every read of DATA0
+// transfers x10 and runs the load for the next word through ABSTRACTAUTO. The load runs ahead of the data
+// returned, so ABSTRACTAUTO is cleared before the read that would load the word following the block and the last
+// word is moved from x10 to DATA0 without running the program buffer.
+static bool ch32v20x_read_memory_block_once(rvswd_handle_t* handle, uint32_t address, uint32_t* data, size_t count) {
+    uint32_t command = (CH32_REGS_GPR + 10)  // Register to access.
+                       | (0 << 16)           // Read access.
+                       | (1 << 17)           // Perform transfer.
+                       | (1 << 18)           // Run program buffer afterwards.
+                       | (2 << 20)           // 32-bit register access.
+                       | (0 << 24);          // Access register command.
+
+    CH32V20X_BATCH(batch, CH32V20X_BLOCK_CHUNK + 8);
+    ch32v20x_batch_write_cpu_reg(handle, &batch, CH32_REGS_GPR + 11, address);
+    ch32v20x_batch_load_program(handle, &batch, ch32v20x_readmem_increment, sizeof(ch32v20x_readmem_increment));
+    ch32v20x_cache_clobber(handle, CH32V20X_GPR(10) | CH32V20X_GPR(11));
+    rvswd_batch_write(&batch, CH32_REG_DEBUG_COMMAND, (1 << 18) | (2 << 20));  // Load the first word into x10
+    if (count > 1) {
+        rvswd_batch_write(&batch, CH32_REG_DEBUG_COMMAND, command);  // Move it to DATA0, load the next
+    }
+    if (count > 2) {
+        rvswd_batch_write(&batch, CH32_REG_DEBUG_ABSTRACTAUTO, 1 << 0);  // Repeat the command on DATA0 access
+    }
+
+    // Every read returns word index and loads word index + 2
+    size_t index = 0;
+    while (index + 2 < count) {
+        size_t chunk = count - 2 - index;
+        if (chunk > CH32V20X_BLOCK_CHUNK) {
+            chunk = CH32V20X_BLOCK_CHUNK;
+        }
+        for (size_t i = 0; i < chunk; i++) {
+            rvswd_batch_read(&batch, CH32_REG_DEBUG_DATA0, &data[index + i]);
+        }
+        index += chunk;
+        if (!ch32v20x_execute(handle, &batch)) {
+            rvswd_write(handle, CH32_REG_DEBUG_ABSTRACTAUTO, 0);
+            return false;
+        }
+        rvswd_batch_clear(&batch);
+    }
+
+    // The last two words are read without loading another
+    if (count > 2) {
+        rvswd_batch_write(&batch, CH32_REG_DEBUG_ABSTRACTAUTO, 0);
+    }
+    if (count > 1) {
+        rvswd_batch_read(&batch, CH32_REG_DEBUG_DATA0, &data[count - 2]);
+    }
+    rvswd_batch_write(&batch, CH32_REG_DEBUG_COMMAND, command & ~(1 << 18));  // Move the last word to DATA0
+    rvswd_batch_read(&batch, CH32_REG_DEBUG_DATA0, &data[count - 1]);
+    if (!ch32v20x_execute(handle, &batch)) {
+        rvswd_write(handle, CH32_REG_DEBUG_ABSTRACTAUTO, 0);
+        return false;
+    }
     return true;
 }
 
+// Write count words starting at address. The program buffer is loaded once, after which every write of DATA0
+// transfers it to x10 and runs the store through ABSTRACTAUTO.
+static bool ch32v20x_write_memory_block_once(rvswd_handle_t* handle, uint32_t address, uint32_t const* data,
+                                             size_t count) {
+    uint32_t command = (CH32_REGS_GPR + 10)  // Register to access.
+                       | (1 << 16)           // Write access.
+                       | (1 << 17)           // Perform transfer.
+                       | (1 << 18)           // Run program buffer afterwards.
+                       | (2 << 20)           // 32-bit register access.
+                       | (0 << 24);          // Access register command.
+
+    CH32V20X_BATCH(batch, CH32V20X_BLOCK_CHUNK + 8);
+    ch32v20x_batch_write_cpu_reg(handle, &batch, CH32_REGS_GPR + 11, address);
+    ch32v20x_batch_load_program(handle, &batch, ch32v20x_writemem_increment, sizeof(ch32v20x_writemem_increment));
+    ch32v20x_cache_clobber(handle, CH32V20X_GPR(10) | CH32V20X_GPR(11));
+    rvswd_batch_write(&batch, CH32_REG_DEBUG_DATA0, data[0]);
+    rvswd_batch_write(&batch, CH32_REG_DEBUG_COMMAND, command);      // Store the first word
+    rvswd_batch_write(&batch, CH32_REG_DEBUG_ABSTRACTAUTO, 1 << 0);  // Repeat the command on DATA0 access
+
+    size_t index = 1;
+    while (index < count) {
+        size_t chunk = count - index;
+        if (chunk > CH32V20X_BLOCK_CHUNK) {
+            chunk = CH32V20X_BLOCK_CHUNK;
+        }
+        for (size_t i = 0; i < chunk; i++) {
+            rvswd_batch_write(&batch, CH32_REG_DEBUG_DATA0, data[index + i]);
+        }
+        index += chunk;
+        if (!ch32v20x_execute(handle, &batch)) {
+            rvswd_write(handle, CH32_REG_DEBUG_ABSTRACTAUTO, 0);
+            return false;
+        }
+        rvswd_batch_clear(&batch);
+    }
+
+    rvswd_batch_write(&batch, CH32_REG_DEBUG_ABSTRACTAUTO, 0);
+    if (!ch32v20x_execute(handle, &batch)) {
+        rvswd_write(handle, CH32_REG_DEBUG_ABSTRACTAUTO, 0);
+        return false;
+    }
+    return true;
+}
+
+// A failed block is transferred again as a whole, blocks are at most a page in practice
+bool ch32v20x_read_memory_block(rvswd_handle_t* handle, uint32_t address, uint32_t* data, size_t count) {
+    if (count == 0) {
+        return true;
+    }
+    if (address % 4) {
+        return false;
+    }
+
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    bool res;
+    uint8_t attempt = 0;
+    do {
+        res = ch32v20x_read_memory_block_once(handle, address, data, count);
+    } while (!res && ch32v20x_retry(handle, &attempt));
+    rvswd_unlock(handle);
+    return res;
+}
+
+bool ch32v20x_write_memory_block(rvswd_handle_t* handle, uint32_t address, uint32_t const* data, size_t count) {
+    if (count == 0) {
+        return true;
+    }
+    if (address % 4) {
+        return false;
+    }
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    ch32v20x_stubs_clobber(handle, address, count * 4);
+    bool res;
+    uint8_t attempt = 0;
+    do {
+        res = ch32v20x_write_memory_block_once(handle, address, data, count);
+    } while (!res && ch32v20x_retry(handle, &attempt));
+    rvswd_unlock(handle);
+    return res;
+}
+
 // Wait for the Flash chip to finish its current operation.
 bool ch32v20x_wait_flash(rvswd_handle_t* handle) {
+    ch32_family_t const* family = ch32_family(handle);
+    if (family == NULL) {
+        return false;
+    }
+    uint32_t statr = family->flash_statr;
+    RVSWD_STATS_START(handle, start);
+    int64_t deadline = rvswd_time_us(handle) + CH32V20X_FLASH_TIMEOUT_US;
+    uint32_t delay_us = 0;
     uint32_t value = 0;
-    ch32v20x_read_memory_word(handle, CH32V20X_FLASH_STATR, &value);
-
-    uint32_t timeout = 1000;
+    if (!ch32v20x_read_memory_word(handle, statr, &value)) {
+        return false;
+    }
 
     while (value & CH32V20X_FLASH_STATR_BSY) {
         ESP_LOGD(TAG, "Flash busy: FLASH_STATR = 0x%08" PRIx32 "\r\n", value);
-        vTaskDelay(1);
-        ch32v20x_read_memory_word(handle, CH32V20X_FLASH_STATR, &value);
-        timeout--;
-        if (timeout == 0) {
+        if (rvswd_time_us(handle) > deadline) {
+            return false;
+        }
+        rvswd_backoff(handle, &delay_us);
+        if (!ch32v20x_read_memory_word(handle, statr, &value)) {
             return false;
         }
     }
+    RVSWD_STATS_STOP(handle, RVSWD_STATS_FLASH_BUSY, start);
     return true;
 }
 
-void ch32v20x_wait_flash_write(rvswd_handle_t* handle) {
+bool ch32v20x_wait_flash_write(rvswd_handle_t* handle) {
+    RVSWD_STATS_START(handle, start);
+    int64_t deadline = rvswd_time_us(handle) + CH32V20X_FLASH_TIMEOUT_US;
     uint32_t value = 0;
-    ch32v20x_read_memory_word(handle, CH32V20X_FLASH_STATR, &value);
-    while (value & CH32V20X_FLASH_STATR_WRBUSY) {
-        ch32v20x_read_memory_word(handle, CH32V20X_FLASH_STATR, &value);
-    }
+    do {
+        if (!ch32v20x_read_memory_word(handle, CH32V20X_FLASH_STATR, &value) || rvswd_time_us(handle) > deadline) {
+            return false;
+        }
+    } while (value & CH32V20X_FLASH_STATR_WRBUSY);
+    RVSWD_STATS_STOP(handle, RVSWD_STATS_FLASH_BUSY, start);
+    return true;
 }
 
 // Unlock the Flash if not already unlocked.
 bool ch32v20x_unlock_flash(rvswd_handle_t* handle) {
-    uint32_t ctlr;
-    ch32v20x_read_memory_word(handle, CH32V20X_FLASH_CTLR, &ctlr);
+    ch32_family_t const* family = ch32_family(handle);
+    if (family == NULL) {
+        return false;
+    }
 
     // Enter the unlock keys.
-    ch32v20x_write_memory_word(handle, 0x40022004, 0x45670123);
-    ch32v20x_write_memory_word(handle, 0x40022004, 0xCDEF89AB);
-    ch32v20x_write_memory_word(handle, 0x40022008, 0x45670123);
-    ch32v20x_write_memory_word(handle, 0x40022008, 0xCDEF89AB);
-    ch32v20x_write_memory_word(handle, 0x40022024, 0x45670123);
-    ch32v20x_write_memory_word(handle, 0x40022024, 0xCDEF89AB);
+    for (size_t i = 0; i < family->key_count; i++) {
+        if (!ch32v20x_write_memory_word(handle, family->keys[i][0], family->keys[i][1])) {
+            return false;
+        }
+    }
 
     // Check again if Flash is unlocked.
-    ch32v20x_read_memory_word(handle, CH32V20X_FLASH_CTLR, &ctlr);
+    uint32_t ctlr;
+    if (!ch32v20x_read_memory_word(handle, family->flash_ctlr, &ctlr)) {
+        return false;
+    }
 
     return ((ctlr & CH32V20X_FLASH_CTLR_LOCK) != CH32V20X_FLASH_CTLR_LOCK);
 }
 
 // Lock the FLASH
 bool ch32v20x_lock_flash(rvswd_handle_t* handle) {
+    ch32_family_t const* family = ch32_family(handle);
+    if (family == NULL) {
+        return false;
+    }
+    uint32_t flash_ctlr = family->flash_ctlr;
     uint32_t ctlr;
+    handle->target_state &= ~CH32_STATE_UNLOCKED;
 
     // Check if Flash is locked
-    ch32v20x_read_memory_word(handle, CH32V20X_FLASH_CTLR, &ctlr);
+    if (!ch32v20x_read_memory_word(handle, flash_ctlr, &ctlr)) {
+        return false;
+    }
 
     if ((ctlr & CH32V20X_FLASH_CTLR_LOCK) == CH32V20X_FLASH_CTLR_LOCK) {
         ESP_LOGW(TAG, "Target Flash already locked");
@@ -255,180 +735,783 @@ bool ch32v20x_lock_flash(rvswd_handle_t* handle) {
     }
 
     // Lock FLASH
-    ch32v20x_write_memory_word(handle, CH32V20X_FLASH_CTLR, ctlr | CH32V20X_FLASH_CTLR_LOCK);
+    if (!ch32v20x_write_memory_word(handle, flash_ctlr, ctlr | CH32V20X_FLASH_CTLR_LOCK)) {
+        return false;
+    }
 
     // Check again if Flash is locked
-    ch32v20x_read_memory_word(handle, CH32V20X_FLASH_CTLR, &ctlr);
+    if (!ch32v20x_read_memory_word(handle, flash_ctlr, &ctlr)) {
+        return false;
+    }
 
     return ((ctlr & CH32V20X_FLASH_CTLR_LOCK) == CH32V20X_FLASH_CTLR_LOCK);
 }
 
-// If unlocked: Erase a 256-byte block of FLASH.
-bool ch32v20x_erase_flash_block(rvswd_handle_t* handle, uint32_t addr) {
-    if (addr % 256) return false;
+// If unlocked: Run an erase operation selected by ctlr on the area containing addr.
+static bool ch32v20x_erase(rvswd_handle_t* handle, uint32_t ctlr, uint32_t addr) {
+    ch32_family_t const* family = ch32_family(handle);
+    if (family == NULL) {
+        return false;
+    }
+    RVSWD_STATS_START(handle, start);
     bool wait_res = ch32v20x_wait_flash(handle);
     if (!wait_res) {
         return false;
     }
-    ch32v20x_write_memory_word(handle, CH32V20X_FLASH_CTLR, CH32V20X_FLASH_CTLR_FTER);
-    ch32v20x_write_memory_word(handle, CH32_FLASH_ADDR, addr);
-    ch32v20x_write_memory_word(handle, CH32V20X_FLASH_CTLR, CH32V20X_FLASH_CTLR_FTER | CH32V20X_FLASH_CTLR_STRT);
+    if (!ch32v20x_write_memory_word(handle, family->flash_ctlr, ctlr) ||
+        !ch32v20x_write_memory_word(handle, family->flash_addr, addr) ||
+        !ch32v20x_write_memory_word(handle, family->flash_ctlr, ctlr | CH32V20X_FLASH_CTLR_STRT)) {
+        return false;
+    }
     wait_res = ch32v20x_wait_flash(handle);
     if (!wait_res) {
         return false;
     }
-    ch32v20x_write_memory_word(handle, CH32V20X_FLASH_CTLR, 0);
-    return true;
+    RVSWD_STATS_STOP(handle, RVSWD_STATS_ERASE, start);
+    return ch32v20x_write_memory_word(handle, family->flash_ctlr, 0);
+}
+
+// If unlocked: Erase a page of FLASH, 256 bytes.
+bool ch32v20x_erase_flash_block(rvswd_handle_t* handle, uint32_t addr) {
+    ch32_family_t const* family = ch32_family(handle);
+    if (family == NULL) {
+        return false;
+    }
+    if (addr % family->page_size) return false;
+    return ch32v20x_erase(handle, CH32V20X_FLASH_CTLR_FTER, addr);
+}
+
+// If unlocked: Erase a sector of FLASH, 4K on the CH32V20X and a 32K block on the CH32X035.
+bool ch32v20x_erase_flash_sector(rvswd_handle_t* handle, uint32_t addr) {
+    ch32_family_t const* family = ch32_family(handle);
+    if (family == NULL) {
+        return false;
+    }
+    if (addr % family->erase_size) return false;
+    return ch32v20x_erase(handle, family->erase_ctlr, addr);
+}
+
+// If unlocked: Erase all of FLASH.
+bool ch32v20x_erase_flash_all(rvswd_handle_t* handle) {
+    ch32_family_t const* family = ch32_family(handle);
+    if (family == NULL) {
+        return false;
+    }
+    return ch32v20x_erase(handle, CH32V20X_FLASH_CTLR_MER, family->flash_begin);
+}
+
+// Load the page buffer and start programming, the caller holds the lock
+static bool ch32v20x_write_flash_block_locked(rvswd_handle_t* handle, uint32_t addr, void const* data) {
+    if (!ch32v20x_write_memory_word(handle, CH32V20X_FLASH_CTLR, CH32V20X_FLASH_CTLR_FTPG) ||
+        !ch32v20x_write_memory_word(handle, CH32_FLASH_ADDR, addr)) {
+        return false;
+    }
+
+    uint8_t const* bytes = data;
+    for (size_t i = 0; i < 64; i++) {
+        uint32_t word;
+        memcpy(&word, &bytes[i * 4], sizeof(word));
+        if (!ch32v20x_write_memory_word(handle, addr + i * 4, word) || !ch32v20x_wait_flash_write(handle)) {
+            return false;
+        }
+    }
+
+    return ch32v20x_write_memory_word(handle, CH32V20X_FLASH_CTLR,
+                                      CH32V20X_FLASH_CTLR_FTPG | CH32V20X_FLASH_CTLR_PGSTRT);
 }
 
-// If unlocked: Write a 256-byte block of FLASH.
+// If unlocked: Write a 256-byte block of FLASH of a CH32V20X from the host, the write_page of its family.
 bool ch32v20x_write_flash_block(rvswd_handle_t* handle, uint32_t addr, void const* data) {
     if (addr % 256) return false;
+    if (!ch32v20x_wait_flash(handle)) {
+        return false;
+    }
 
-    bool wait_res = ch32v20x_wait_flash(handle);
-    if (!wait_res) {
+    // The lock is only held while the page buffer is loaded, not while the page is programmed
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    bool res = ch32v20x_write_flash_block_locked(handle, addr, data);
+    rvswd_unlock(handle);
+    return res && ch32v20x_wait_flash(handle) && ch32v20x_write_memory_word(handle, CH32V20X_FLASH_CTLR, 0);
+}
+
+static uint32_t const ch32v20x_flash_keys[][2] = {
+    {0x40022004, 0x45670123}, {0x40022004, 0xCDEF89AB},  // KEYR, unlocks the flash
+    {0x40022008, 0x45670123}, {0x40022008, 0xCDEF89AB},  // OBKEYR, unlocks the option bytes
+    {0x40022024, 0x45670123}, {0x40022024, 0xCDEF89AB},  // MODEKEYR, unlocks fast programming
+};
+
+ch32_family_t const ch32_family_ch32v20x = {
+    .name = "CH32V20X",
+    .chip_id_mask = 0xFF000000,
+    .chip_id = 0x20000000,
+    .flash_begin = CH32_CODE_BEGIN,
+    .max_pages = CH32V20X_MAX_PAGES,
+    .page_size = CH32V20X_PAGE_SIZE,
+    .erase_size = CH32V20X_SECTOR_SIZE,
+    .erase_ctlr = CH32V20X_FLASH_CTLR_PER,
+    .flash_statr = CH32V20X_FLASH_STATR,
+    .flash_ctlr = CH32V20X_FLASH_CTLR,
+    .flash_addr = CH32_FLASH_ADDR,
+    .flash_capacity = CH32V20X_ADDR_ESIG_FLACAP,
+    .option_bytes = CH32V20X_ADDR_OPTION_BYTES,
+    .keys = ch32v20x_flash_keys,
+    .key_count = sizeof(ch32v20x_flash_keys) / sizeof(ch32v20x_flash_keys[0]),
+    .loader = ch32v20x_flash_loader,
+    .loader_words = sizeof(ch32v20x_flash_loader) / sizeof(uint32_t),
+    .loader_clobber = CH32V20X_LOADER_CLOBBER,
+    .write_page = ch32v20x_write_flash_block,
+};
+
+// Wait for an abstract command, including a program buffer that calls into a stub, to complete.
+static bool ch32v20x_wait_abstract(rvswd_handle_t* handle, uint32_t timeout_ms) {
+    uint32_t value = 0;
+    rvswd_result_t res = rvswd_poll(handle, CH32_REG_DEBUG_ABSTRACTCS, 1 << 12, 0, timeout_ms * 1000, &value);
+    if (res != RVSWD_OK) {
+        ESP_LOGE(TAG, "Timeout while waiting for abstract command, ABSTRACTCS=%" PRIx32, value);
         return false;
     }
-    ch32v20x_write_memory_word(handle, CH32V20X_FLASH_CTLR, CH32V20X_FLASH_CTLR_FTPG);
+    return true;
+}
 
-    ch32v20x_write_memory_word(handle, CH32_FLASH_ADDR, addr);
+// Start the stub at address in SRAM with arguments in a2, a3 and a4 from the program buffer, the registers in clobber
+// are those the stub changes, the link register is always included. Abstract commands fail while the stub runs, the
+// caller holds the lock until ch32v20x_finish_stub.
+static bool ch32v20x_start_stub(rvswd_handle_t* handle, uint32_t address, uint32_t clobber, uint32_t a2, uint32_t a3,
+                                uint32_t a4) {
+    CH32V20X_BATCH(batch, 10);
+    ch32v20x_batch_write_cpu_reg(handle, &batch, CH32_REGS_GPR + 6, address);
+    ch32v20x_batch_write_cpu_reg(handle, &batch, CH32_REGS_GPR + 12, a2);
+    ch32v20x_batch_write_cpu_reg(handle, &batch, CH32_REGS_GPR + 13, a3);
+    ch32v20x_batch_write_cpu_reg(handle, &batch, CH32_REGS_GPR + 14, a4);
+    ch32v20x_batch_load_program(handle, &batch, ch32v20x_call_stub_program, sizeof(ch32v20x_call_stub_program));
+    rvswd_batch_write(&batch, CH32_REG_DEBUG_COMMAND, (1 << 18) | (2 << 20));  // Run the program buffer
+    ch32v20x_cache_clobber(handle, clobber | CH32V20X_GPR(1));
+    return ch32v20x_execute(handle, &batch);
+}
 
-    uint32_t wdata[64];
-    memcpy(wdata, data, sizeof(wdata));
-    for (size_t i = 0; i < 64; i++) {
-        ch32v20x_write_memory_word(handle, addr + i * 4, wdata[i]);
-        ch32v20x_wait_flash_write(handle);
+// Wait for the stub started by ch32v20x_start_stub to return, returns a0.
+static bool ch32v20x_finish_stub(rvswd_handle_t* handle, uint32_t timeout_ms, uint32_t* result) {
+    if (!ch32v20x_wait_abstract(handle, timeout_ms)) {
+        rvswd_cache_invalidate(handle);
+        return false;
     }
+    return ch32v20x_read_cpu_reg(handle, CH32_REGS_GPR + 10, result);
+}
 
-    ch32v20x_write_memory_word(handle, CH32V20X_FLASH_CTLR, CH32V20X_FLASH_CTLR_FTPG | CH32V20X_FLASH_CTLR_PGSTRT);
-    wait_res = ch32v20x_wait_flash(handle);
-    if (!wait_res) {
+// Call the stub at address in SRAM with arguments in a2, a3 and a4 and wait for it to return a0. A failed call is
+// repeated, only stubs without side effects are called this way.
+static bool ch32v20x_call_stub(rvswd_handle_t* handle, uint32_t address, uint32_t clobber, uint32_t a2, uint32_t a3,
+                               uint32_t a4, uint32_t timeout_ms, uint32_t* result) {
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    bool res;
+    uint8_t attempt = 0;
+    do {
+        res = ch32v20x_start_stub(handle, address, clobber, a2, a3, a4) &&
+              ch32v20x_finish_stub(handle, timeout_ms, result);
+    } while (!res && ch32v20x_retry(handle, &attempt));
+    rvswd_unlock(handle);
+    return res;
+}
+
+// Start programming an erased page through the flash loader, only the page data and the call cross the wire. The
+// host is free to do other work until ch32v20x_finish_flash_block_loader.
+static bool ch32v20x_start_flash_block_loader(rvswd_handle_t* handle, ch32_family_t const* family, uint32_t addr,
+                                              uint32_t const* data) {
+    if (!ch32v20x_write_memory_block(handle, CH32V20X_LOADER_BUFFER, data, family->page_size / 4)) {
         return false;
     }
-    ch32v20x_write_memory_word(handle, CH32V20X_FLASH_CTLR, 0);
-    vTaskDelay(1);
+    return ch32v20x_start_stub(handle, CH32V20X_LOADER_ADDR, family->loader_clobber, addr, CH32V20X_LOADER_BUFFER,
+                               0);
+}
 
-    uint32_t rdata[64];
-    for (size_t i = 0; i < 64; i++) {
-        vTaskDelay(0);
-        ch32v20x_read_memory_word(handle, addr + i * 4, &rdata[i]);
+static bool ch32v20x_finish_flash_block_loader(rvswd_handle_t* handle, uint32_t addr) {
+    uint32_t statr = 0;
+    if (!ch32v20x_finish_stub(handle, 100, &statr)) {
+        return false;
+    }
+    if (statr & CH32V20X_FLASH_STATR_WRPRTERR) {
+        ESP_LOGE(TAG, "Write protection error at %08" PRIx32, addr);
+        return false;
+    }
+    return true;
+}
+
+// Upload the stubs the flags call for into the target SRAM, unless they are known to be there already
+static bool ch32v20x_upload_stubs(rvswd_handle_t* handle, ch32_family_t const* family, uint32_t flags) {
+    if ((flags & CH32V20X_PROGRAM_LOADER) && !(handle->target_state & CH32_STATE_LOADER)) {
+        if (!ch32v20x_write_memory_block(handle, CH32V20X_LOADER_ADDR, family->loader, family->loader_words)) {
+            ESP_LOGE(TAG, "Failed to upload flash loader");
+            return false;
+        }
+        handle->target_state |= CH32_STATE_LOADER;
+    }
+    if ((flags & (CH32V20X_PROGRAM_VERIFY_CRC | CH32V20X_PROGRAM_DIFFERENTIAL)) &&
+        !(handle->target_state & CH32_STATE_CRC32)) {
+        if (!ch32v20x_write_memory_block(handle, CH32V20X_CRC32_ADDR, ch32v20x_crc32_stub,
+                                         sizeof(ch32v20x_crc32_stub) / sizeof(uint32_t))) {
+            ESP_LOGE(TAG, "Failed to upload CRC32 stub");
+            return false;
+        }
+        handle->target_state |= CH32_STATE_CRC32;
+    }
+    return true;
+}
+
+// Calculate the CRC32 of a range of target memory on the target itself. The stub is uploaded under the same lock, as
+// another task may have overwritten it since it was last used.
+bool ch32v20x_crc32(rvswd_handle_t* handle, uint32_t addr, size_t len, uint32_t* crc_out) {
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    bool res = ch32v20x_upload_stubs(handle, ch32_family(handle), CH32V20X_PROGRAM_VERIFY_CRC) &&
+               ch32v20x_call_stub(handle, CH32V20X_CRC32_ADDR, CH32V20X_CRC32_CLOBBER, addr, len, 0, 1000, crc_out);
+    rvswd_unlock(handle);
+    return res;
+}
+
+// Compare a block of Flash with data.
+static bool ch32v20x_verify_flash_block(rvswd_handle_t* handle, uint32_t addr, void const* data, size_t size,
+                                        uint32_t flags) {
+    if (flags & CH32V20X_PROGRAM_VERIFY_CRC) {
+        uint32_t crc = 0;
+        if (!ch32v20x_crc32(handle, addr, size, &crc)) {
+            ESP_LOGE(TAG, "Failed to calculate CRC at %08" PRIx32, addr);
+            return false;
+        }
+        uint32_t expected = esp_rom_crc32_le(0, data, size);
+        if (crc != expected) {
+            ESP_LOGE(TAG, "CRC mismatch at %08" PRIx32 ": %08" PRIx32 " instead of %08" PRIx32, addr, crc, expected);
+            return false;
+        }
+    }
+
+    if (flags & CH32V20X_PROGRAM_VERIFY_READBACK) {
+        uint32_t rdata[CH32_MAX_PAGE_SIZE / 4];
+        if (size > sizeof(rdata) || !ch32v20x_read_memory_block(handle, addr, rdata, size / 4)) {
+            ESP_LOGE(TAG, "Failed to read back block at %08" PRIx32, addr);
+            return false;
+        }
+        if (memcmp(data, rdata, size)) {
+            ESP_LOGE(TAG, "Write block mismatch at %08" PRIx32, addr);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Check whether a page already holds data
+static bool ch32v20x_flash_block_matches(rvswd_handle_t* handle, uint32_t addr, uint32_t const* data, size_t size,
+                                         bool* match) {
+    uint32_t crc = 0;
+    if (!ch32v20x_crc32(handle, addr, size, &crc)) {
+        ESP_LOGE(TAG, "Failed to calculate CRC at %08" PRIx32, addr);
+        return false;
+    }
+    *match = crc == esp_rom_crc32_le(0, (uint8_t const*)data, size);
+    return true;
+}
+
+// Copy page index of the image into page, padding the end of the image with erased bytes
+static bool ch32v20x_get_page(rvswd_source_t const* source, size_t page_size, size_t index, uint32_t* page) {
+    size_t offset = index * page_size;
+    size_t length = source->length - offset < page_size ? source->length - offset : page_size;
+    memset(page, 0xFF, page_size);
+    if (!rvswd_source_read(source, offset, page, length)) {
+        ESP_LOGE(TAG, "Failed to read image at offset %zu", offset);
+        return false;
     }
-    if (memcmp(wdata, rdata, sizeof(wdata))) {
-        ESP_LOGE(TAG, "Write block mismatch at %08" PRIx32, addr);
-        ESP_LOGE(TAG, "Write:");
-        for (size_t i = 0; i < 64; i++) {
-            ESP_LOGE(TAG, "%zx: %08" PRIx32, i, wdata[i]);
+    return true;
+}
+
+// CRC32 of the image, padded with erased bytes up to a whole number of pages when padded is set
+static bool ch32v20x_image_crc32(rvswd_source_t const* source, size_t page_size, bool padded, uint32_t* crc_out) {
+    uint32_t page[CH32_MAX_PAGE_SIZE / 4];
+    uint32_t crc = 0;
+    for (size_t offset = 0; offset < source->length; offset += page_size) {
+        if (!ch32v20x_get_page(source, page_size, offset / page_size, page)) {
+            return false;
         }
-        ESP_LOGE(TAG, "Read:");
-        for (size_t i = 0; i < 64; i++) {
-            ESP_LOGE(TAG, "%zx: %08" PRIx32, i, rdata[i]);
+        size_t length = source->length - offset;
+        if (padded || length > page_size) {
+            length = page_size;
         }
+        crc = esp_rom_crc32_le(crc, (uint8_t const*)page, length);
+    }
+    *crc_out = crc;
+    return true;
+}
+
+// Check whether the whole range already holds the image, with the last page padded with 0xFF
+static bool ch32v20x_flash_matches(rvswd_handle_t* handle, uint32_t addr, rvswd_source_t const* source,
+                                   bool* match) {
+    ch32_family_t const* family = ch32_family(handle);
+    if (family == NULL) {
+        return false;
+    }
+    size_t page_size = family->page_size;
+    size_t padded_len = (source->length + page_size - 1) / page_size * page_size;
+    uint32_t crc = 0;
+    if (!ch32v20x_crc32(handle, addr, padded_len, &crc)) {
+        ESP_LOGE(TAG, "Failed to calculate CRC at %08" PRIx32, addr);
         return false;
     }
 
+    uint32_t expected = 0;
+    if (!ch32v20x_image_crc32(source, page_size, true, &expected)) {
+        return false;
+    }
+    *match = crc == expected;
     return true;
 }
 
 // If unlocked: Erase and write a range of Flash memory.
 bool ch32v20x_write_flash(rvswd_handle_t* handle, uint32_t addr, void const* _data, size_t data_len,
                           ch32v20x_status_callback status_callback) {
-    if (addr % 64) {
-        return false;
+    return ch32v20x_write_flash_ex(handle, addr, _data, data_len, CH32V20X_PROGRAM_VERIFY_READBACK, status_callback,
+                                   NULL);
+}
+
+static inline bool ch32v20x_page_dirty(uint32_t const* dirty, size_t index) {
+    return (dirty[index / 32] >> (index % 32)) & 1;
+}
+
+// Index of the first dirty page at or after index, page_count when there is none
+static size_t ch32v20x_next_dirty(uint32_t const* dirty, size_t index, size_t page_count) {
+    while (index < page_count && !ch32v20x_page_dirty(dirty, index)) {
+        index++;
+    }
+    return index;
+}
+
+// Erase all pages marked dirty in a single pass, using the largest erase operations that do not touch clean pages
+// or flash outside of the range.
+static bool ch32v20x_erase_pages(rvswd_handle_t* handle, ch32_family_t const* family, uint32_t addr,
+                                 uint32_t const* dirty, size_t page_count, uint32_t flags,
+                                 ch32v20x_program_stats_t* stats) {
+    size_t dirty_count = 0;
+    for (size_t i = 0; i < page_count; i++) {
+        dirty_count += ch32v20x_page_dirty(dirty, i);
+    }
+
+    // A mass erase takes about as long as a single sector erase but also clears everything after the range
+    if ((flags & CH32V20X_PROGRAM_MASS_ERASE) && addr == family->flash_begin && dirty_count == page_count) {
+        stats->erase_operations++;
+        return ch32v20x_erase_flash_all(handle);
     }
 
-    uint8_t const* data = _data;
+    size_t pages_per_sector = family->erase_size / family->page_size;
+    size_t index = 0;
+    while (index < page_count) {
+        uint32_t page_addr = addr + index * family->page_size;
 
-    char buffer[32];
+        if (page_addr % family->erase_size == 0 && index + pages_per_sector <= page_count) {
+            size_t sector_dirty = 0;
+            for (size_t i = 0; i < pages_per_sector; i++) {
+                sector_dirty += ch32v20x_page_dirty(dirty, index + i);
+            }
+            if (sector_dirty == pages_per_sector) {
+                stats->erase_operations++;
+                if (!ch32v20x_erase_flash_sector(handle, page_addr)) {
+                    ESP_LOGE(TAG, "Error: Failed to erase Flash sector at %08" PRIx32, page_addr);
+                    return false;
+                }
+                index += pages_per_sector;
+                continue;
+            }
+        }
+
+        if (ch32v20x_page_dirty(dirty, index)) {
+            stats->erase_operations++;
+            if (!ch32v20x_erase_flash_block(handle, page_addr)) {
+                ESP_LOGE(TAG, "Error: Failed to erase Flash at %08" PRIx32, page_addr);
+                return false;
+            }
+        }
+        index++;
+    }
+    return true;
+}
+
+// Next page of the image, read while the flash loader programs the current page
+typedef struct ch32v20x_prefetch {
+    rvswd_source_t const* source;
+    size_t page_size;
+    size_t index;    // Page to read
+    uint32_t* page;  // Receives the page
+    bool done;       // The page was read, or there is no page left to read
+    bool res;        // Result of reading the page
+} ch32v20x_prefetch_t;
+
+static void ch32v20x_prefetch(ch32v20x_prefetch_t* prefetch) {
+    if (!prefetch->done) {
+        prefetch->res = ch32v20x_get_page(prefetch->source, prefetch->page_size, prefetch->index, prefetch->page);
+        prefetch->done = true;
+    }
+}
 
-    for (size_t i = 0; i < data_len; i += 256) {
-        vTaskDelay(0);
-        snprintf(buffer, sizeof(buffer) - 1, "Writing at 0x%08" PRIx32, addr + i);
-        if (status_callback) {
-            status_callback(buffer, i * 100 / data_len);
+// Program an erased page. The flash loader owns the debug module until it returns, so the lock is held from uploading
+// the stubs, which another task may have overwritten, until the loader finished. The next page is read meanwhile
+// unless another task waits for the handle, then it is left to the caller to read it after the lock is released.
+// Without the loader the flash functions take the lock for every transaction and not while waiting for the flash.
+static bool ch32v20x_program_page(rvswd_handle_t* handle, ch32_family_t const* family, uint32_t page_addr,
+                                  uint32_t const* page, uint32_t flags, ch32v20x_prefetch_t* prefetch) {
+    if (!(flags & CH32V20X_PROGRAM_LOADER)) {
+        return family->write_page(handle, page_addr, page);
+    }
+
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    bool res = ch32v20x_upload_stubs(handle, family, CH32V20X_PROGRAM_LOADER) &&
+               ch32v20x_start_flash_block_loader(handle, family, page_addr, page);
+    if (res && prefetch && !rvswd_lock_waiting(handle)) {
+        ch32v20x_prefetch(prefetch);
+    }
+    res = res && ch32v20x_finish_flash_block_loader(handle, page_addr);
+    rvswd_unlock(handle);
+    return res;
+}
+
+// Erase, program and verify a page again after an attempt failed. The stubs are uploaded again too, the attempt may
+// have failed on a copy corrupted on the wire.
+static bool ch32v20x_rewrite_page(rvswd_handle_t* handle, ch32_family_t const* family, uint32_t page_addr,
+                                  uint32_t const* page, uint32_t flags, ch32v20x_program_stats_t* stats) {
+    // A stub left running by the failed attempt blocks every abstract command, and a lost write may have left
+    // ABSTRACTAUTO set, which repeats the last command on every DATA0 access
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    handle->target_state &= ~(CH32_STATE_LOADER | CH32_STATE_CRC32);
+    bool res = ch32v20x_wait_abstract(handle, 100);
+    if (res) {
+        rvswd_write(handle, CH32_REG_DEBUG_ABSTRACTAUTO, 0);
+        rvswd_write(handle, CH32_REG_DEBUG_ABSTRACTCS, CH32V20X_ABSTRACTCS_CMDERR);
+        rvswd_cache_invalidate(handle);
+    }
+    rvswd_unlock(handle);
+    if (!res) {
+        return false;
+    }
+    stats->erase_operations++;
+    return ch32v20x_erase_flash_block(handle, page_addr) &&
+           ch32v20x_program_page(handle, family, page_addr, page, flags, NULL) &&
+           ch32v20x_verify_flash_block(handle, page_addr, page, family->page_size, flags);
+}
+
+static bool ch32v20x_write_flash_pages(rvswd_handle_t* handle, ch32_family_t const* family, uint32_t addr,
+                                       rvswd_source_t const* source, uint32_t flags,
+                                       ch32v20x_progress_callback progress, void* ctx,
+                                       ch32v20x_program_stats_t* stats) {
+    size_t page_count = stats->pages_total;
+    size_t page_size = family->page_size;
+    uint32_t dirty[CH32V20X_MAX_PAGES / 32];
+    uint32_t pages[2][CH32_MAX_PAGE_SIZE / 4];
+
+    // Find the pages that need to be written
+    memset(dirty, 0, sizeof(dirty));
+    for (size_t i = 0; i < page_count; i++) {
+        bool match = false;
+        if (flags & CH32V20X_PROGRAM_DIFFERENTIAL) {
+            if (!ch32v20x_get_page(source, page_size, i, pages[0]) ||
+                !ch32v20x_flash_block_matches(handle, addr + i * page_size, pages[0], page_size, &match)) {
+                return false;
+            }
         }
+        if (!match) {
+            dirty[i / 32] |= 1UL << (i % 32);
+        }
+    }
+
+    if (progress && !progress(ctx, CH32V20X_PHASE_ERASE, addr, 0, page_count)) {
+        ESP_LOGW(TAG, "Programming cancelled");
+        return false;
+    }
+    if (!ch32v20x_erase_pages(handle, family, addr, dirty, page_count, flags, stats)) {
+        return false;
+    }
+
+    // Pages are read from the source one ahead, the next page is read while the flash loader programs the current
+    size_t index = ch32v20x_next_dirty(dirty, 0, page_count);
+    if (index < page_count && !ch32v20x_get_page(source, page_size, index, pages[0])) {
+        return false;
+    }
+
+    while (index < page_count) {
+        uint32_t* page = pages[stats->pages_written % 2];
+        uint32_t* next_page = pages[(stats->pages_written + 1) % 2];
+        uint32_t page_addr = addr + index * page_size;
+        size_t next = ch32v20x_next_dirty(dirty, index + 1, page_count);
 
-        if (!ch32v20x_erase_flash_block(handle, addr + i)) {
-            ESP_LOGE(TAG, "Error: Failed to erase Flash at %08" PRIx32, addr + i);
+        if (progress && !progress(ctx, CH32V20X_PHASE_WRITE, page_addr, index, page_count)) {
+            ESP_LOGW(TAG, "Programming cancelled at %08" PRIx32, page_addr);
             return false;
         }
 
-        if (!ch32v20x_write_flash_block(handle, addr + i, data + i)) {
-            ESP_LOGE(TAG, "Error: Failed to write Flash at %08" PRIx32, addr + i);
+        // Other tasks get the handle while the flash is busy and between the steps of a page
+        ch32v20x_prefetch_t prefetch = {
+            .source = source,
+            .page_size = page_size,
+            .index = next,
+            .page = next_page,
+            .done = next == page_count,
+            .res = true,
+        };
+        RVSWD_STATS_START(handle, program_start);
+        bool write_res = ch32v20x_program_page(handle, family, page_addr, page, flags, &prefetch);
+        RVSWD_STATS_STOP(handle, RVSWD_STATS_PROGRAM, program_start);
+        ch32v20x_prefetch(&prefetch);
+        if (write_res && (flags & (CH32V20X_PROGRAM_VERIFY_CRC | CH32V20X_PROGRAM_VERIFY_READBACK))) {
+            RVSWD_STATS_START(handle, verify_start);
+            write_res = ch32v20x_verify_flash_block(handle, page_addr, page, page_size, flags);
+            RVSWD_STATS_STOP(handle, RVSWD_STATS_VERIFY, verify_start);
+        }
+
+        // Only the page that failed is programmed again, not the whole image
+        for (uint8_t attempt = 1; !write_res && attempt < CH32V20X_PAGE_ATTEMPTS; attempt++) {
+            ESP_LOGW(TAG, "Programming %08" PRIx32 " failed, erasing it to try again", page_addr);
+            stats->pages_retried++;
+            write_res = ch32v20x_rewrite_page(handle, family, page_addr, page, flags, stats);
+        }
+        if (!write_res) {
+            ESP_LOGE(TAG, "Error: Failed to write Flash at %08" PRIx32, page_addr);
             return false;
         }
+        if (!prefetch.res) {
+            return false;
+        }
+        stats->pages_written++;
+        index = next;
     }
 
+    stats->pages_skipped = page_count - stats->pages_written;
+    return true;
+}
+
+// If unlocked: Erase and write a range of Flash memory, flags select how pages are programmed and verified.
+bool ch32v20x_write_flash_ex(rvswd_handle_t* handle, uint32_t addr, void const* _data, size_t data_len,
+                             uint32_t flags, ch32v20x_status_callback status_callback,
+                             ch32v20x_program_stats_t* stats) {
+    rvswd_source_t source;
+    rvswd_source_memory(&source, _data, data_len);
+    return ch32v20x_write_flash_source(handle, addr, &source, flags, status_callback, stats);
+}
+
+// Report progress to the ch32v20x_status_callback ctx points to
+static bool ch32v20x_status_progress(void* ctx, ch32v20x_phase_t phase, uint32_t addr, size_t index, size_t total) {
+    ch32v20x_status_callback status_callback = *(ch32v20x_status_callback*)ctx;
+    switch (phase) {
+        case CH32V20X_PHASE_ERASE:
+            status_callback("Erasing", 0);
+            break;
+        case CH32V20X_PHASE_WRITE: {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer) - 1, "Writing at 0x%08" PRIx32, addr);
+            status_callback(buffer, index * 100 / total);
+            break;
+        }
+        case CH32V20X_PHASE_DONE:
+            status_callback("Programming done", 100);
+            break;
+    }
     return true;
 }
 
+bool ch32v20x_write_flash_source(rvswd_handle_t* handle, uint32_t addr, rvswd_source_t const* source, uint32_t flags,
+                                 ch32v20x_status_callback status_callback, ch32v20x_program_stats_t* stats) {
+    ch32v20x_progress_callback progress = status_callback ? ch32v20x_status_progress : NULL;
+    return ch32v20x_write_flash_source_ex(handle, addr, source, flags, progress, &status_callback, stats);
+}
+
+bool ch32v20x_write_flash_source_ex(rvswd_handle_t* handle, uint32_t addr, rvswd_source_t const* source,
+                                    uint32_t flags, ch32v20x_progress_callback progress, void* ctx,
+                                    ch32v20x_program_stats_t* stats) {
+    ch32_family_t const* family = ch32_family(handle);
+    if (family == NULL || addr % family->page_size) {
+        return false;
+    }
+
+    ch32v20x_program_stats_t local_stats;
+    if (stats == NULL) {
+        stats = &local_stats;
+    }
+    memset(stats, 0, sizeof(ch32v20x_program_stats_t));
+    stats->pages_total = (source->length + family->page_size - 1) / family->page_size;
+    if (stats->pages_total > family->max_pages) {
+        ESP_LOGE(TAG, "Image of %zu bytes does not fit in flash", source->length);
+        return false;
+    }
+
+    if (!ch32v20x_upload_stubs(handle, family, flags)) {
+        return false;
+    }
+
+    // A single CRC over the whole range settles the common case of an unchanged image
+    if (flags & CH32V20X_PROGRAM_DIFFERENTIAL) {
+        bool match = false;
+        if (!ch32v20x_flash_matches(handle, addr, source, &match)) {
+            return false;
+        }
+        if (match) {
+            stats->pages_skipped = stats->pages_total;
+            return true;
+        }
+    }
+
+    return ch32v20x_write_flash_pages(handle, family, addr, source, flags, progress, ctx, stats);
+}
+
+// Clear the status flags left by an earlier operation and wait for one still running to finish
 bool ch32v20x_clear_running_operations(rvswd_handle_t* handle) {
-    uint32_t timeout = 100;
+    ch32_family_t const* family = ch32_family(handle);
+    if (family == NULL) {
+        return false;
+    }
+    int64_t deadline = rvswd_time_us(handle) + CH32V20X_FLASH_TIMEOUT_US;
+    uint32_t delay_us = 0;
     while (1) {
         uint32_t value = 0;
-        ch32v20x_read_memory_word(handle, CH32V20X_FLASH_STATR, &value);
+        if (!ch32v20x_read_memory_word(handle, family->flash_statr, &value)) {
+            return false;
+        }
         if (value & CH32V20X_FLASH_STATR_BSY) {
             if (value & CH32V20X_FLASH_STATR_EOP) {
                 ESP_LOGD(TAG, "Clearing EOP flag...\r\n");
-                ch32v20x_write_memory_word(handle, CH32V20X_FLASH_STATR, value | CH32V20X_FLASH_STATR_EOP);
+                if (!ch32v20x_write_memory_word(handle, family->flash_statr, value | CH32V20X_FLASH_STATR_EOP)) {
+                    return false;
+                }
             } else if (value & CH32V20X_FLASH_STATR_WRPRTERR) {
                 ESP_LOGD(TAG, "Clearing WRPRTERR flag...\r\n");
-                ch32v20x_write_memory_word(handle, CH32V20X_FLASH_STATR, value | CH32V20X_FLASH_STATR_WRPRTERR);
-            } else if (value & CH32V20X_FLASH_STATR_WRBUSY) {
-                ESP_LOGD(TAG, "Waiting for busy flag to clear...\r\n");
-                timeout--;
-                if (timeout == 0) {
-                    ESP_LOGE(TAG, "Timeout while waiting for target to clear busy flag!\r\n");
+                if (!ch32v20x_write_memory_word(handle, family->flash_statr, value | CH32V20X_FLASH_STATR_WRPRTERR)) {
                     return false;
                 }
-            } else {
+            } else if (rvswd_time_us(handle) > deadline) {
                 uint32_t ctlr_value = 0;
-                ch32v20x_read_memory_word(handle, CH32V20X_FLASH_CTLR, &ctlr_value);
+                ch32v20x_read_memory_word(handle, family->flash_ctlr, &ctlr_value);
                 ESP_LOGE(TAG,
-                         "Target busy for unknown reason (FLASH_STATR: 0x%08" PRIx32 ", FLASH_CTLR: 0x%08" PRIx32
-                         ")!\r\n",
+                         "Timeout while waiting for target to clear busy flag (FLASH_STATR: 0x%08" PRIx32
+                         ", FLASH_CTLR: 0x%08" PRIx32 ")!\r\n",
                          value, ctlr_value);
                 return false;
             }
-            vTaskDelay(pdMS_TO_TICKS(10));
+            rvswd_backoff(handle, &delay_us);
         } else {
             return true;
         }
     }
 }
 
-// Configure option bytes of the CH32V20X
-bool ch32v20x_read_option_bytes(rvswd_handle_t* handle) {
-    rvswd_result_t res;
-
-    res = rvswd_init(handle);
+// Connect to the target, halt it and look up its family. With reset set the target is reset first, so no firmware is
+// running while the flash is accessed. Within a session the target is only halted again when it was resumed.
+static bool ch32v20x_attach_locked(rvswd_handle_t* handle, bool reset) {
+    if (handle->target_state & CH32_STATE_OPEN) {
+        return (handle->target_state & CH32_STATE_HALTED) || ch32v20x_halt_microprocessor(handle) == RVSWD_OK;
+    }
 
+    handle->target_state = 0;
+    rvswd_result_t res = rvswd_init(handle);
     if (res != RVSWD_OK) {
         ESP_LOGE(TAG, "RVSWD initialization error %u!", res);
         return false;
     }
 
     res = rvswd_reset(handle);
-
     if (res != RVSWD_OK) {
         ESP_LOGE(TAG, "RVSWD reset error %u!", res);
         return false;
     }
 
-    res = ch32v20x_reset_microprocessor_and_run(handle);
+    res = ch32v20x_connect(handle);
     if (res != RVSWD_OK) {
-        ESP_LOGE(TAG, "Failed to reset target");
+        ESP_LOGE(TAG, "No clock rate passes the DATA0 loopback");
         return false;
     }
 
+    if (reset) {
+        res = ch32v20x_reset_microprocessor_and_run(handle);
+        if (res != RVSWD_OK) {
+            ESP_LOGE(TAG, "Failed to reset target");
+            return false;
+        }
+    }
+
     res = ch32v20x_halt_microprocessor(handle);
     if (res != RVSWD_OK) {
         ESP_LOGE(TAG, "Failed to halt target");
         return false;
     }
 
+    // Looked up once, every flash function after this takes the family from the handle
+    handle->target = ch32_family_detect(handle);
+    if (handle->target == NULL) {
+        ESP_LOGE(TAG, "Target not supported");
+        return false;
+    }
+    return true;
+}
+
+bool ch32v20x_attach(rvswd_handle_t* handle, bool reset) {
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    bool res = ch32v20x_attach_locked(handle, reset);
+    rvswd_unlock(handle);
+    return res;
+}
+
+// Unlock the flash and clear what an earlier flash operation left behind, unless that is done already
+static bool ch32v20x_prepare_flash(rvswd_handle_t* handle) {
+    if (handle->target_state & CH32_STATE_UNLOCKED) {
+        return true;
+    }
+    if (!ch32v20x_unlock_flash(handle)) {
+        ESP_LOGE(TAG, "Failed to unlock flash");
+        return false;
+    }
+    if (!ch32v20x_clear_running_operations(handle)) {
+        ESP_LOGE(TAG, "Failed to clear target running operations");
+        return false;
+    }
+    handle->target_state |= CH32_STATE_UNLOCKED;
+    return true;
+}
+
+bool ch32v20x_session_open(rvswd_handle_t* handle, bool reset) {
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    handle->target_state = 0;
+    bool result = ch32v20x_attach(handle, reset) && ch32v20x_prepare_flash(handle);
+    if (result) {
+        handle->target_state |= CH32_STATE_OPEN;
+    }
+    rvswd_unlock(handle);
+    return result;
+}
+
+bool ch32v20x_session_close(rvswd_handle_t* handle, bool reset) {
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    bool result = true;
+    if ((handle->target_state & CH32_STATE_UNLOCKED) && !ch32v20x_lock_flash(handle)) {
+        ESP_LOGE(TAG, "Failed to lock target flash");
+        result = false;
+    }
+    handle->target_state = 0;
+
+    rvswd_result_t res;
+    if (reset) {
+        res = ch32v20x_reset_microprocessor_and_run(handle);
+    } else {
+        res = ch32v20x_resume_microprocessor(handle);
+    }
+    if (res != RVSWD_OK) {
+        ESP_LOGE(TAG, "Failed to restart target");
+        result = false;
+    }
+    rvswd_unlock(handle);
+    return result;
+}
+
+// Configure option bytes of the CH32V20X
+bool ch32v20x_read_option_bytes(rvswd_handle_t* handle) {
+    if (!ch32v20x_attach(handle, true)) {
+        return false;
+    }
+
     uint32_t option_bytes[4] = {0};
-    for (uint8_t i = 0; i < 4; i++) {
-        ch32v20x_read_memory_word(handle, CH32V20X_ADDR_OPTION_BYTES + (i * 4), &option_bytes[i]);
+    if (!ch32v20x_read_memory_block(handle, ch32_family(handle)->option_bytes, option_bytes, 4)) {
+        ESP_LOGE(TAG, "Failed to read option bytes");
+        return false;
     }
 
     uint8_t rdpr = ((option_bytes[0] >> 0) & 0xFF);
@@ -519,71 +1602,221 @@ bool ch32v20x_read_option_bytes(rvswd_handle_t* handle) {
     return true;
 }
 
-// Program and restart the CH32V20X
-bool ch32v20x_program(rvswd_handle_t* handle, void const* firmware, size_t firmware_len,
-                      ch32v20x_status_callback status_callback) {
-    rvswd_result_t res;
-
-    res = rvswd_init(handle);
+// Address of the fingerprint, the last page of flash
+static bool ch32v20x_fingerprint_address(rvswd_handle_t* handle, uint32_t* addr) {
+    ch32_family_t const* family = ch32_family(handle);
+    uint32_t flacap = 0;
+    if (!ch32v20x_read_memory_word(handle, family->flash_capacity, &flacap)) {
+        return false;
+    }
+    uint32_t size_kb = flacap & 0xFFFF;
+    if (size_kb == 0 || size_kb == 0xFFFF) {
+        ESP_LOGE(TAG, "Invalid flash capacity %08" PRIx32, flacap);
+        return false;
+    }
+    *addr = family->flash_begin + size_kb * 1024 - family->page_size;
+    return true;
+}
 
-    if (res != RVSWD_OK) {
-        ESP_LOGE(TAG, "RVSWD initialization error %u!", res);
+static bool ch32v20x_fingerprint_create(rvswd_source_t const* firmware, size_t page_size,
+                                        ch32v20x_fingerprint_t* fingerprint) {
+    fingerprint->magic = CH32V20X_FINGERPRINT_MAGIC;
+    fingerprint->length = firmware->length;
+    if (!ch32v20x_image_crc32(firmware, page_size, false, &fingerprint->crc)) {
         return false;
     }
+    fingerprint->crc_inverted = ~fingerprint->crc;
+    return true;
+}
 
-    res = rvswd_reset(handle);
+static bool ch32v20x_fingerprint_read(rvswd_handle_t* handle, uint32_t addr, ch32v20x_fingerprint_t* fingerprint) {
+    return ch32v20x_read_memory_block(handle, addr, (uint32_t*)fingerprint, sizeof(ch32v20x_fingerprint_t) / 4);
+}
 
-    if (res != RVSWD_OK) {
-        ESP_LOGE(TAG, "RVSWD reset error %u!", res);
+// Check the fingerprint left by CH32V20X_PROGRAM_FINGERPRINT, halts the target once and leaves it running
+bool ch32v20x_is_firmware_current(rvswd_handle_t* handle, void const* firmware, size_t firmware_len) {
+    rvswd_source_t source;
+    rvswd_source_memory(&source, firmware, firmware_len);
+    return ch32v20x_is_firmware_current_source(handle, &source);
+}
+
+bool ch32v20x_is_firmware_current_source(rvswd_handle_t* handle, rvswd_source_t const* firmware) {
+    if (!ch32v20x_attach(handle, false)) {
+        // The attach fails after halting a target of an unknown family
+        if ((handle->target_state & (CH32_STATE_HALTED | CH32_STATE_OPEN)) == CH32_STATE_HALTED &&
+            ch32v20x_resume_microprocessor(handle) != RVSWD_OK) {
+            ESP_LOGE(TAG, "Failed to resume target");
+        }
         return false;
     }
 
-    res = ch32v20x_reset_microprocessor_and_run(handle);
-    if (res != RVSWD_OK) {
-        ESP_LOGE(TAG, "Failed to reset target");
+    uint32_t addr = 0;
+    ch32v20x_fingerprint_t stored = {0};
+    bool read_res = ch32v20x_fingerprint_address(handle, &addr) && ch32v20x_fingerprint_read(handle, addr, &stored);
+
+    if (!(handle->target_state & CH32_STATE_OPEN) && ch32v20x_resume_microprocessor(handle) != RVSWD_OK) {
+        ESP_LOGE(TAG, "Failed to resume target");
+    }
+
+    if (!read_res) {
         return false;
     }
 
-    res = ch32v20x_halt_microprocessor(handle);
-    if (res != RVSWD_OK) {
-        ESP_LOGE(TAG, "Failed to halt target");
+    ch32v20x_fingerprint_t expected;
+    if (!ch32v20x_fingerprint_create(firmware, ch32_family(handle)->page_size, &expected)) {
         return false;
     }
+    return memcmp(&stored, &expected, sizeof(ch32v20x_fingerprint_t)) == 0;
+}
 
-    bool bool_res = ch32v20x_unlock_flash(handle);
+// Program and restart the CH32V20X
+bool ch32v20x_program(rvswd_handle_t* handle, void const* firmware, size_t firmware_len,
+                      ch32v20x_status_callback status_callback) {
+    return ch32v20x_program_ex(handle, firmware, firmware_len, CH32V20X_PROGRAM_DEFAULT, status_callback, NULL);
+}
 
-    if (!bool_res) {
-        ESP_LOGE(TAG, "Failed to unlock flash");
+bool ch32v20x_program_ex(rvswd_handle_t* handle, void const* firmware, size_t firmware_len, uint32_t flags,
+                         ch32v20x_status_callback status_callback, ch32v20x_program_stats_t* stats) {
+    rvswd_source_t source;
+    rvswd_source_memory(&source, firmware, firmware_len);
+    return ch32v20x_program_source(handle, &source, flags, status_callback, stats);
+}
+
+bool ch32v20x_program_source(rvswd_handle_t* handle, rvswd_source_t const* firmware, uint32_t flags,
+                             ch32v20x_status_callback status_callback, ch32v20x_program_stats_t* stats) {
+    ch32v20x_progress_callback progress = status_callback ? ch32v20x_status_progress : NULL;
+    return ch32v20x_program_source_ex(handle, firmware, flags, progress, &status_callback, stats);
+}
+
+bool ch32v20x_program_source_ex(rvswd_handle_t* handle, rvswd_source_t const* firmware, uint32_t flags,
+                                ch32v20x_progress_callback progress, void* ctx, ch32v20x_program_stats_t* stats) {
+    if (!ch32v20x_attach(handle, true)) {
         return false;
     }
+    ch32_family_t const* family = ch32_family(handle);
 
-    bool_res = ch32v20x_clear_running_operations(handle);
+    bool bool_res = ch32v20x_prepare_flash(handle);
     if (!bool_res) {
-        ESP_LOGE(TAG, "Failed to clear target running operations");
         return false;
-    };
+    }
+
+    // The last page holds the fingerprint, it is invalidated first so an interrupted update is never reported as
+    // current by ch32v20x_is_firmware_current
+    uint32_t fingerprint_addr = 0;
+    ch32v20x_fingerprint_t fingerprint;
+    if (flags & CH32V20X_PROGRAM_FINGERPRINT) {
+        if (!ch32v20x_fingerprint_address(handle, &fingerprint_addr)) {
+            return false;
+        }
+        if (family->flash_begin + firmware->length > fingerprint_addr) {
+            ESP_LOGE(TAG, "Firmware overlaps the fingerprint at %08" PRIx32, fingerprint_addr);
+            return false;
+        }
+
+        ch32v20x_fingerprint_t stored;
+        if (!ch32v20x_fingerprint_create(firmware, family->page_size, &fingerprint) ||
+            !ch32v20x_fingerprint_read(handle, fingerprint_addr, &stored)) {
+            return false;
+        }
+        if (stored.magic == CH32V20X_FINGERPRINT_MAGIC &&
+            memcmp(&stored, &fingerprint, sizeof(ch32v20x_fingerprint_t)) != 0 &&
+            !ch32v20x_erase_flash_block(handle, fingerprint_addr)) {
+            ESP_LOGE(TAG, "Failed to invalidate fingerprint");
+            return false;
+        }
+    }
 
-    bool_res = ch32v20x_write_flash(handle, 0x08000000, firmware, firmware_len, status_callback);
+    bool_res = ch32v20x_write_flash_source_ex(handle, family->flash_begin, firmware, flags, progress, ctx, stats);
     if (!bool_res) {
         ESP_LOGE(TAG, "Failed to write target flash");
         return false;
     };
 
-    bool_res = ch32v20x_lock_flash(handle);
-    if (!bool_res) {
-        ESP_LOGE(TAG, "Failed to lock target flash");
+    if (flags & CH32V20X_PROGRAM_FINGERPRINT) {
+        uint32_t page[CH32_MAX_PAGE_SIZE / 4];
+        memset(page, 0xFF, sizeof(page));
+        memcpy(page, &fingerprint, sizeof(fingerprint));
+        bool_res = ch32v20x_write_flash_ex(handle, fingerprint_addr, page, family->page_size, flags, NULL, NULL);
+        if (!bool_res) {
+            ESP_LOGE(TAG, "Failed to write fingerprint");
+            return false;
+        }
+    }
+
+    // Within a session the target stays halted and unlocked until ch32v20x_session_close
+    if (!(handle->target_state & CH32_STATE_OPEN)) {
+        bool_res = ch32v20x_lock_flash(handle);
+        if (!bool_res) {
+            ESP_LOGE(TAG, "Failed to lock target flash");
+            return false;
+        };
+
+        if (ch32v20x_reset_microprocessor_and_run(handle) != RVSWD_OK) {
+            ESP_LOGE(TAG, "Failed to reset target to run firmware");
+            return false;
+        }
+    }
+
+    if (progress) {
+        progress(ctx, CH32V20X_PHASE_DONE, 0, 0, 0);
+    }
+
+    return true;
+}
+
+bool ch32v20x_program_gang(rvswd_handle_t* handle, void const* firmware, size_t firmware_len, uint32_t flags,
+                           ch32v20x_status_callback status_callback, ch32v20x_program_stats_t* stats) {
+    rvswd_gang_t* gang = handle->transport_ctx;
+
+    // Targets that must all hold the image afterwards, all of them when none were selected yet as with rvswd_init.
+    // The selection is kept when attaching initializes the transport again.
+    uint32_t requested = rvswd_gang_select(handle, gang->selected ? gang->selected : UINT32_MAX);
+    if (requested == 0) {
         return false;
-    };
+    }
+    rvswd_source_t source;
+    rvswd_source_memory(&source, firmware, firmware_len);
+
+    // A page or fingerprint matching on one target says nothing about the others, reads return the combined value
+    // of all targets
+    flags &= ~(CH32V20X_PROGRAM_DIFFERENTIAL | CH32V20X_PROGRAM_FINGERPRINT);
+    bool programmed = ch32v20x_program_source(handle, &source, flags, status_callback, stats);
+
+    // The targets that took part in programming are verified one by one, even after a failure, to find out
+    // which of them hold the image
+    uint32_t targets = rvswd_gang_select(handle, gang->selected);
+    if (targets == 0) {
+        return false;
+    }
 
-    res = ch32v20x_reset_microprocessor_and_run(handle);
-    if (res != RVSWD_OK) {
-        ESP_LOGE(TAG, "Failed to reset target to run firmware");
+    // The family is unknown when the targets differ, their chip IDs are read combined. The CRC32 stub is uploaded to
+    // all targets at once, ch32v20x_crc32 finds it in place for every single one.
+    ch32_family_t const* family = ch32_family(handle);
+    if (family == NULL || ch32v20x_halt_microprocessor(handle) != RVSWD_OK ||
+        !ch32v20x_upload_stubs(handle, family, CH32V20X_PROGRAM_VERIFY_CRC)) {
+        for (uint8_t i = 0; i < gang->count; i++) {
+            if (targets & (1UL << i)) {
+                rvswd_gang_fail(handle, i, RVSWD_FAIL);
+            }
+        }
         return false;
     }
 
-    if (status_callback) {
-        status_callback("Programming done", 100);
+    for (uint8_t i = 0; i < gang->count; i++) {
+        if (!(targets & (1UL << i)) || rvswd_gang_select(handle, 1UL << i) == 0) {
+            continue;
+        }
+        bool match = false;
+        if (!ch32v20x_flash_matches(handle, family->flash_begin, &source, &match) || !match) {
+            ESP_LOGE(TAG, "Target %u does not hold the image", i);
+            rvswd_gang_fail(handle, i, RVSWD_FAIL);
+        }
     }
 
-    return true;
+    // The CRC32 stub overwrote SRAM of the firmware, start it from reset
+    uint32_t verified = rvswd_gang_select(handle, targets);
+    if (verified != 0 && ch32v20x_reset_microprocessor_and_run(handle) != RVSWD_OK) {
+        return false;
+    }
+    return programmed && verified == requested;
 }
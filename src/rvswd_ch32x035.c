@@ -0,0 +1,211 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "rvswd_ch32x035.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "ch32x035_registers.h"
+#include "esp_log.h"
+#include "rvswd_ch32.h"
+#include "rvswd_ch32v20x.h"
+#include "rvswd_source.h"
+
+static char const TAG[] = "CH32X035";
+
+#define CH32X035_CODE_BEGIN 0x08000000  // The start of the code flash
+#define CH32X035_PAGE_SIZE  256         // Size of a fast programming and fast erase page
+#define CH32X035_BLOCK_SIZE 32768       // Size of a BER32 block erase
+#define CH32X035_MAX_PAGES  256         // Pages in the largest flash of the family, 64K
+
+#define CH32X035_FLASH_TIMEOUT_US 500000      // Longest flash operation, a block erase
+#define CH32X035_LOADER_CLOBBER   0x0000CCA0  // Registers changed by the flash loader: t0, t2, a0, a1, a4 and a5
+
+// Flash loader, programs the erased page at a2 with the 256 bytes at a3 through the page buffer, returns FLASH_STATR
+// in a0
+static uint32_t const ch32x035_flash_loader[] = {
+    0x400227b7,  // lui a5, 0x40022
+    0x000102b7,  // lui t0, 0x10            (FTPG)
+    0x0057a823,  // sw t0, 0x10(a5)         (CTLR)
+    0x000902b7,  // lui t0, 0x90            (FTPG | BUFRST)
+    0x0057a823,  // sw t0, 0x10(a5)
+    0x00c7a283,  // reset_wait: lw t0, 0x0c(a5)
+    0x0012f293,  // andi t0, t0, 1          (BSY)
+    0xfe029ce3,  // bnez t0, reset_wait
+    0x00060513,  // mv a0, a2
+    0x00068593,  // mv a1, a3
+    0x04000393,  // li t2, 64
+    0x00050737,  // lui a4, 0x50            (FTPG | BUFLOAD)
+    0x0005a283,  // copy: lw t0, 0(a1)
+    0x00552023,  // sw t0, 0(a0)
+    0x00e7a823,  // sw a4, 0x10(a5)
+    0x00c7a283,  // load_wait: lw t0, 0x0c(a5)
+    0x0012f293,  // andi t0, t0, 1          (BSY)
+    0xfe029ce3,  // bnez t0, load_wait
+    0x00450513,  // addi a0, a0, 4
+    0x00458593,  // addi a1, a1, 4
+    0xfff38393,  // addi t2, t2, -1
+    0xfc039ee3,  // bnez t2, copy
+    0x00c7aa23,  // sw a2, 0x14(a5)         (ADDR)
+    0x000102b7,  // lui t0, 0x10
+    0x04028293,  // addi t0, t0, 0x40       (FTPG | STRT)
+    0x0057a823,  // sw t0, 0x10(a5)
+    0x00c7a283,  // program_wait: lw t0, 0x0c(a5)
+    0x0012f293,  // andi t0, t0, 1          (BSY)
+    0xfe029ce3,  // bnez t0, program_wait
+    0x00c7a503,  // lw a0, 0x0c(a5)
+    0x00a7a623,  // sw a0, 0x0c(a5)         (clear EOP and WRPRTERR)
+    0x0007a823,  // sw zero, 0x10(a5)
+    0x00008067,  // ret
+};
+
+// Wait for the flash controller to finish its current operation
+static bool ch32x035_wait_flash(rvswd_handle_t* handle) {
+    int64_t deadline = rvswd_time_us(handle) + CH32X035_FLASH_TIMEOUT_US;
+    uint32_t delay_us = 0;
+    uint32_t value = 0;
+    while (1) {
+        if (!ch32v20x_read_memory_word(handle, CH32X035_FLASH_STATR, &value)) {
+            return false;
+        }
+        if (!(value & CH32X035_FLASH_STATR_BSY)) {
+            return true;
+        }
+        if (rvswd_time_us(handle) > deadline) {
+            ESP_LOGE(TAG, "Timeout while waiting for flash, FLASH_STATR=%08" PRIx32, value);
+            return false;
+        }
+        rvswd_backoff(handle, &delay_us);
+    }
+}
+
+// Write CTLR and wait for the operation it starts
+static bool ch32x035_flash_command(rvswd_handle_t* handle, uint32_t ctlr) {
+    return ch32v20x_write_memory_word(handle, CH32X035_FLASH_CTLR, ctlr) && ch32x035_wait_flash(handle);
+}
+
+// The generic erases follow the family of the target, only run them on a CH32X035
+static bool ch32x035_is_target(rvswd_handle_t* handle) {
+    return ch32_family(handle) == &ch32_family_ch32x035;
+}
+
+// If unlocked: Erase a 256-byte page of flash.
+bool ch32x035_erase_flash_page(rvswd_handle_t* handle, uint32_t addr) {
+    return ch32x035_is_target(handle) && ch32v20x_erase_flash_block(handle, addr);
+}
+
+// If unlocked: Erase a 32K block of flash.
+bool ch32x035_erase_flash_block(rvswd_handle_t* handle, uint32_t addr) {
+    return ch32x035_is_target(handle) && ch32v20x_erase_flash_sector(handle, addr);
+}
+
+// Load the page buffer and start programming, the caller holds the lock
+static bool ch32x035_write_flash_page_locked(rvswd_handle_t* handle, uint32_t addr, void const* data) {
+    if (!ch32x035_flash_command(handle, CH32X035_FLASH_CTLR_FTPG) ||
+        !ch32x035_flash_command(handle, CH32X035_FLASH_CTLR_FTPG | CH32X035_FLASH_CTLR_BUFRST)) {
+        return false;
+    }
+
+    uint8_t const* bytes = data;
+    for (size_t i = 0; i < CH32X035_PAGE_SIZE / 4; i++) {
+        uint32_t word;
+        memcpy(&word, &bytes[i * 4], sizeof(word));
+        if (!ch32v20x_write_memory_word(handle, addr + i * 4, word) ||
+            !ch32x035_flash_command(handle, CH32X035_FLASH_CTLR_FTPG | CH32X035_FLASH_CTLR_BUFLOAD)) {
+            return false;
+        }
+    }
+
+    return ch32v20x_write_memory_word(handle, CH32X035_FLASH_ADDR, addr) &&
+           ch32v20x_write_memory_word(handle, CH32X035_FLASH_CTLR, CH32X035_FLASH_CTLR_FTPG | CH32X035_FLASH_CTLR_STRT);
+}
+
+// If unlocked: Program an erased 256-byte page of flash from the host, every word is moved into the page buffer with
+// BUFLOAD before STRT programs the page.
+bool ch32x035_write_flash_page(rvswd_handle_t* handle, uint32_t addr, void const* data) {
+    if (addr % CH32X035_PAGE_SIZE) return false;
+    if (!ch32x035_wait_flash(handle)) {
+        return false;
+    }
+
+    // The lock is only held while the page buffer is loaded, not while the page is programmed
+    rvswd_lock(handle, RVSWD_WAIT_FOREVER);
+    bool res = ch32x035_write_flash_page_locked(handle, addr, data);
+    rvswd_unlock(handle);
+    return res && ch32x035_wait_flash(handle) && ch32v20x_write_memory_word(handle, CH32X035_FLASH_CTLR, 0);
+}
+
+static uint32_t const ch32x035_flash_keys[][2] = {
+    {0x40022004, 0x45670123}, {0x40022004, 0xCDEF89AB},  // KEYR, unlocks the flash
+    {0x40022024, 0x45670123}, {0x40022024, 0xCDEF89AB},  // MODEKEYR, unlocks fast programming
+};
+
+ch32_family_t const ch32_family_ch32x035 = {
+    .name = "CH32X035",
+    .chip_id_mask = 0xFFF00000,
+    .chip_id = 0x03500000,
+    .flash_begin = CH32X035_CODE_BEGIN,
+    .max_pages = CH32X035_MAX_PAGES,
+    .page_size = CH32X035_PAGE_SIZE,
+    .erase_size = CH32X035_BLOCK_SIZE,
+    .erase_ctlr = CH32X035_FLASH_CTLR_BER32,
+    .flash_statr = CH32X035_FLASH_STATR,
+    .flash_ctlr = CH32X035_FLASH_CTLR,
+    .flash_addr = CH32X035_FLASH_ADDR,
+    .flash_capacity = CH32X035_ADDR_ESIG_FLACAP,
+    .option_bytes = CH32X035_ADDR_OPTION_BYTES,
+    .keys = ch32x035_flash_keys,
+    .key_count = sizeof(ch32x035_flash_keys) / sizeof(ch32x035_flash_keys[0]),
+    .loader = ch32x035_flash_loader,
+    .loader_words = sizeof(ch32x035_flash_loader) / sizeof(uint32_t),
+    .loader_clobber = CH32X035_LOADER_CLOBBER,
+    .write_page = ch32x035_write_flash_page,
+};
+
+// Program and restart the CH32X035
+bool ch32x035_program(rvswd_handle_t* handle, void const* firmware, size_t firmware_len,
+                      ch32v20x_status_callback status_callback) {
+    return ch32v20x_program(handle, firmware, firmware_len, status_callback);
+}
+
+bool ch32x035_program_ex(rvswd_handle_t* handle, void const* firmware, size_t firmware_len, uint32_t flags,
+                         ch32v20x_status_callback status_callback, ch32v20x_program_stats_t* stats) {
+    return ch32v20x_program_ex(handle, firmware, firmware_len, flags, status_callback, stats);
+}
+
+bool ch32x035_program_source(rvswd_handle_t* handle, rvswd_source_t const* firmware, uint32_t flags,
+                             ch32v20x_status_callback status_callback, ch32v20x_program_stats_t* stats) {
+    return ch32v20x_program_source(handle, firmware, flags, status_callback, stats);
+}
+
+// Print the option bytes of the CH32X035
+bool ch32x035_read_option_bytes(rvswd_handle_t* handle) {
+    if (!ch32v20x_attach(handle, true)) {
+        return false;
+    }
+
+    uint32_t option_bytes[4] = {0};
+    if (!ch32v20x_read_memory_block(handle, CH32X035_ADDR_OPTION_BYTES, option_bytes, 4)) {
+        ESP_LOGE(TAG, "Failed to read option bytes");
+        return false;
+    }
+
+    // Every option byte is stored next to its inverse
+    static char const* const names[] = {"RDPR", "USER", "Data 0", "Data 1", "WRPR 0", "WRPR 1", "WRPR 2", "WRPR 3"};
+    for (size_t i = 0; i < 8; i++) {
+        uint16_t half = option_bytes[i / 2] >> ((i % 2) * 16);
+        uint8_t value = half & 0xFF;
+        uint8_t inverse = half >> 8;
+        if ((uint8_t)~inverse != value) {
+            printf("Invalid %s value 0x%02x 0x%02x\r\n", names[i], value, inverse);
+        } else if (i == 0) {
+            printf("Read protection %s\r\n", value == 0xA5 ? "disabled" : "enabled");
+        } else {
+            printf("%s: 0x%02x\r\n", names[i], value);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,39 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "rvswd_frame.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+size_t rvswd_frame_encode_write(uint8_t reg, uint32_t value, uint8_t* buffer) {
+    // Left align the 52 bit frame in a 56 bit word and store it big endian
+    uint64_t frame =
+        ((uint64_t)rvswd_frame_header(reg, true) << 38) | ((uint64_t)value << 6) | rvswd_frame_trailer(value);
+    frame <<= 4;
+    for (size_t i = 0; i < RVSWD_FRAME_WRITE_BYTES; i++) {
+        buffer[i] = frame >> (8 * (RVSWD_FRAME_WRITE_BYTES - 1 - i));
+    }
+    return RVSWD_FRAME_WRITE_BITS;
+}
+
+size_t rvswd_frame_encode_read(uint8_t reg, uint8_t* buffer) {
+    uint16_t header = rvswd_frame_header(reg, false) << 2;
+    buffer[0] = header >> 8;
+    buffer[1] = header & 0xFF;
+    return RVSWD_FRAME_HEADER_BITS;
+}
+
+rvswd_result_t rvswd_frame_decode_read(uint8_t const* buffer, size_t offset, uint32_t* value) {
+    // Gather the 33 bits into a 64 bit word, the bits may start anywhere within the first byte
+    buffer += offset / 8;
+    uint64_t bits = 0;
+    for (size_t i = 0; i < 5; i++) {
+        bits = (bits << 8) | buffer[i];
+    }
+    bits <<= offset % 8;
+    *value = bits >> 8;
+    return rvswd_frame_check(*value, (bits >> 7) & 1);
+}
@@ -0,0 +1,345 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "rvswd_gang.h"
+#include <stdint.h>
+#include "rvswd.h"
+#include "rvswd_frame.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "driver/gpio.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "rom/ets_sys.h"
+#include "soc/gpio_reg.h"
+#include "soc/soc.h"
+#endif
+
+// Every edge is a single write to the GPIO set/clear registers covering the lines of all selected targets. Read
+// bits are sampled as whole input register words, the bits of a target are only gathered once the frame is over.
+
+static inline void gang_rvswd_write_lines(rvswd_gang_t* gang, uint32_t mask, bool level) {
+#if !CONFIG_IDF_TARGET_LINUX
+    if (gang->port == NULL) {
+        REG_WRITE(level ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, mask);
+        return;
+    }
+#endif
+    gang->port->write(gang->port->ctx, level ? mask : 0, level ? 0 : mask);
+}
+
+static inline uint32_t gang_rvswd_read_lines(rvswd_gang_t* gang) {
+#if !CONFIG_IDF_TARGET_LINUX
+    if (gang->port == NULL) {
+        return REG_READ(GPIO_IN_REG);
+    }
+#endif
+    return gang->port->read(gang->port->ctx);
+}
+
+static void gang_rvswd_delay_us(rvswd_handle_t* handle, uint32_t us) {
+    rvswd_gang_t* gang = handle->transport_ctx;
+#if !CONFIG_IDF_TARGET_LINUX
+    if (gang->port == NULL) {
+        ets_delay_us(us);
+        return;
+    }
+#endif
+    gang->port->delay_us(gang->port->ctx, us);
+}
+
+static int64_t gang_rvswd_time_us(rvswd_handle_t* handle) {
+    rvswd_gang_t* gang = handle->transport_ctx;
+#if !CONFIG_IDF_TARGET_LINUX
+    if (gang->port == NULL) {
+        return esp_timer_get_time();
+    }
+#endif
+    return gang->port->time_us(gang->port->ctx);
+}
+
+static inline void gang_rvswd_swdio(rvswd_gang_t* gang, bool level) {
+    gang_rvswd_write_lines(gang, gang->swdio_mask, level);
+}
+
+static inline void gang_rvswd_swclk(rvswd_gang_t* gang, bool level) {
+    gang_rvswd_write_lines(gang, gang->swclk_mask, level);
+}
+
+// Stretch the clock phase to handle->clock_cycles, nothing is added when the clock is not limited or the lines are
+// simulated
+static inline void gang_rvswd_half_period(rvswd_handle_t* handle) {
+#if !CONFIG_IDF_TARGET_LINUX
+    rvswd_gang_t* gang = handle->transport_ctx;
+    if (handle->clock_cycles && gang->port == NULL) {
+        uint32_t start = esp_cpu_get_cycle_count();
+        while (esp_cpu_get_cycle_count() - start < handle->clock_cycles) {
+        }
+    }
+#endif
+}
+
+static void gang_rvswd_update_masks(rvswd_gang_t* gang) {
+    gang->swdio_mask = 0;
+    gang->swclk_mask = 0;
+    for (uint8_t i = 0; i < gang->count; i++) {
+        if (gang->selected & (1UL << i)) {
+            gang->swdio_mask |= 1UL << gang->swdio[i];
+            gang->swclk_mask |= 1UL << gang->swclk[i];
+        }
+    }
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static rvswd_result_t gang_rvswd_config_pins(uint64_t swdio_pins, uint64_t swclk_pins) {
+    gpio_config_t swio_cfg = {
+        .pin_bit_mask = swdio_pins,
+        .mode = GPIO_MODE_INPUT_OUTPUT_OD,
+        .pull_up_en = true,
+        .pull_down_en = false,
+        .intr_type = GPIO_INTR_DISABLE,
+    };
+    if (gpio_config(&swio_cfg) != ESP_OK) {
+        return RVSWD_FAIL;
+    }
+
+    gpio_config_t swck_cfg = {
+        .pin_bit_mask = swclk_pins,
+        .mode = GPIO_MODE_OUTPUT,
+        .pull_up_en = false,
+        .pull_down_en = false,
+        .intr_type = GPIO_INTR_DISABLE,
+    };
+    if (gpio_config(&swck_cfg) != ESP_OK) {
+        return RVSWD_FAIL;
+    }
+    return RVSWD_OK;
+}
+#endif
+
+static rvswd_result_t gang_rvswd_init(rvswd_handle_t* handle) {
+    rvswd_gang_t* gang = handle->transport_ctx;
+    if (gang == NULL || gang->count == 0 || gang->count > RVSWD_GANG_MAX) {
+        return RVSWD_INVALID_ARGS;
+    }
+#if CONFIG_IDF_TARGET_LINUX
+    if (gang->port == NULL) {
+        return RVSWD_INVALID_ARGS;
+    }
+#endif
+
+    uint64_t swdio_pins = 0;
+    uint64_t swclk_pins = 0;
+    for (uint8_t i = 0; i < gang->count; i++) {
+        // The set, clear and input registers of the first bank cover GPIO 0 to 31
+        if (gang->swdio[i] < 0 || gang->swdio[i] > 31 || gang->swclk[i] < 0 || gang->swclk[i] > 31) {
+            return RVSWD_INVALID_ARGS;
+        }
+        swdio_pins |= 1ULL << gang->swdio[i];
+        swclk_pins |= 1ULL << gang->swclk[i];
+        gang->value[i] = 0;
+    }
+    if (swdio_pins & swclk_pins) {
+        return RVSWD_INVALID_ARGS;
+    }
+
+#if !CONFIG_IDF_TARGET_LINUX
+    if (gang->port == NULL && gang_rvswd_config_pins(swdio_pins, swclk_pins) != RVSWD_OK) {
+        return RVSWD_FAIL;
+    }
+#endif
+
+    // Attaching initializes the transport again, the targets left out or failed before stay out
+    rvswd_gang_select(handle, gang->selected ? gang->selected : UINT32_MAX);
+
+    // Idle with all lines high, including those of targets deselected later on
+    gang_rvswd_write_lines(gang, (uint32_t)(swdio_pins | swclk_pins), true);
+    return RVSWD_OK;
+}
+
+static void gang_rvswd_start(rvswd_handle_t* handle) {
+    rvswd_gang_t* gang = handle->transport_ctx;
+
+    // Start with both lines high
+    gang_rvswd_swdio(gang, true);
+    gang_rvswd_swclk(gang, true);
+    gang_rvswd_delay_us(handle, 2);
+
+    // Pull data low
+    gang_rvswd_swdio(gang, false);
+    gang_rvswd_delay_us(handle, 1);
+
+    // Pull clock low
+    gang_rvswd_swclk(gang, false);
+    gang_rvswd_delay_us(handle, 1);
+}
+
+static void gang_rvswd_stop(rvswd_handle_t* handle) {
+    rvswd_gang_t* gang = handle->transport_ctx;
+
+    // Pull data low
+    gang_rvswd_swdio(gang, false);
+    gang_rvswd_delay_us(handle, 1);
+    gang_rvswd_swclk(gang, true);
+    gang_rvswd_delay_us(handle, 2);
+    // Let data float high
+    gang_rvswd_swdio(gang, true);
+    gang_rvswd_delay_us(handle, 1);
+}
+
+static void gang_rvswd_reset(rvswd_handle_t* handle) {
+    rvswd_gang_t* gang = handle->transport_ctx;
+
+    gang_rvswd_swdio(gang, true);
+    gang_rvswd_delay_us(handle, 1);
+    for (uint8_t i = 0; i < 100; i++) {
+        gang_rvswd_swclk(gang, false);
+        gang_rvswd_delay_us(handle, 1);
+        gang_rvswd_swclk(gang, true);
+        gang_rvswd_delay_us(handle, 1);
+    }
+    gang_rvswd_stop(handle);
+}
+
+static void gang_rvswd_write_bits(rvswd_handle_t* handle, uint32_t bits, uint8_t count) {
+    rvswd_gang_t* gang = handle->transport_ctx;
+    while (count--) {
+        gang_rvswd_swdio(gang, (bits >> count) & 1);
+        gang_rvswd_swclk(gang, false);
+        gang_rvswd_half_period(handle);
+        gang_rvswd_swclk(gang, true);  // Data is sampled on rising edge of clock
+        gang_rvswd_half_period(handle);
+    }
+}
+
+// Clock in count bits, storing the input register as sampled after every rising edge
+static void gang_rvswd_sample(rvswd_handle_t* handle, uint32_t* samples, uint8_t count) {
+    rvswd_gang_t* gang = handle->transport_ctx;
+    gang_rvswd_swdio(gang, true);
+    for (uint8_t i = 0; i < count; i++) {
+        gang_rvswd_swclk(gang, false);
+        gang_rvswd_half_period(handle);
+        gang_rvswd_swclk(gang, true);  // Data is output on rising edge of clock
+        gang_rvswd_half_period(handle);
+        samples[i] = gang_rvswd_read_lines(gang);
+    }
+}
+
+// Gather the bits of one target from the samples, MSB first
+static uint64_t gang_rvswd_gather(rvswd_gang_t* gang, uint8_t target, uint32_t const* samples, uint8_t count) {
+    uint64_t bits = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        bits = (bits << 1) | ((samples[i] >> gang->swdio[target]) & 1);
+    }
+    return bits;
+}
+
+static uint32_t gang_rvswd_read_bits(rvswd_handle_t* handle, uint8_t count) {
+    rvswd_gang_t* gang = handle->transport_ctx;
+    uint32_t samples[32];
+    gang_rvswd_sample(handle, samples, count);
+
+    uint32_t bits = 0;
+    for (uint8_t i = 0; i < gang->count; i++) {
+        if (gang->selected & (1UL << i)) {
+            bits |= gang_rvswd_gather(gang, i, samples, count);
+        }
+    }
+    return bits;
+}
+
+static rvswd_result_t gang_rvswd_read_frame(rvswd_handle_t* handle, uint8_t reg, uint32_t* value) {
+    rvswd_gang_t* gang = handle->transport_ctx;
+    if (gang->selected == 0) {
+        return RVSWD_FAIL;
+    }
+
+    uint32_t samples[RVSWD_FRAME_DATA_BITS];
+    gang_rvswd_start(handle);
+    gang_rvswd_write_bits(handle, rvswd_frame_header(reg, false), RVSWD_FRAME_HEADER_BITS);
+    gang_rvswd_sample(handle, samples, RVSWD_FRAME_DATA_BITS);
+    gang_rvswd_write_bits(handle, RVSWD_FRAME_DATA_TRAILER, RVSWD_FRAME_TRAILER_BITS);
+    gang_rvswd_stop(handle);
+
+    rvswd_result_t res = RVSWD_PARITY_ERROR;
+    *value = 0;
+    for (uint8_t i = 0; i < gang->count; i++) {
+        if (!(gang->selected & (1UL << i))) {
+            continue;
+        }
+        uint64_t bits = gang_rvswd_gather(gang, i, samples, RVSWD_FRAME_DATA_BITS);
+        uint32_t data = bits >> 1;
+        if (rvswd_frame_check(data, bits & 1) != RVSWD_OK) {
+            // The target missed this frame, it can not follow the others any more
+            rvswd_gang_fail(handle, i, RVSWD_PARITY_ERROR);
+            continue;
+        }
+        gang->value[i] = data;
+        *value |= data;
+        res = RVSWD_OK;
+    }
+    return res;
+}
+
+// Reads return the OR of all targets, a set bit only holds everywhere when every target returned it
+static bool gang_rvswd_match(rvswd_handle_t* handle, uint32_t mask, uint32_t expected) {
+    rvswd_gang_t* gang = handle->transport_ctx;
+    for (uint8_t i = 0; i < gang->count; i++) {
+        if ((gang->selected & (1UL << i)) && (gang->value[i] & mask) != expected) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t rvswd_gang_select(rvswd_handle_t* handle, uint32_t mask) {
+    rvswd_gang_t* gang = handle->transport_ctx;
+    mask &= (1UL << gang->count) - 1;
+    for (uint8_t i = 0; i < gang->count; i++) {
+        if (gang->result[i] != RVSWD_OK) {
+            mask &= ~(1UL << i);
+        }
+    }
+    gang->selected = mask;
+    gang_rvswd_update_masks(gang);
+
+    // The targets left out miss the following frames, the register contents are no longer the same everywhere
+    rvswd_cache_invalidate(handle);
+    return mask;
+}
+
+void rvswd_gang_fail(rvswd_handle_t* handle, uint8_t target, rvswd_result_t result) {
+    rvswd_gang_t* gang = handle->transport_ctx;
+    if (target >= gang->count) {
+        return;
+    }
+    if (gang->result[target] == RVSWD_OK) {
+        gang->result[target] = result;
+    }
+    gang->selected &= ~(1UL << target);
+    gang_rvswd_update_masks(gang);
+}
+
+void rvswd_gang_clear(rvswd_handle_t* handle) {
+    rvswd_gang_t* gang = handle->transport_ctx;
+    for (uint8_t i = 0; i < gang->count; i++) {
+        gang->result[i] = RVSWD_OK;
+    }
+    rvswd_gang_select(handle, UINT32_MAX);
+}
+
+rvswd_transport_t const rvswd_transport_gang = {
+    .init = gang_rvswd_init,
+    .start = gang_rvswd_start,
+    .stop = gang_rvswd_stop,
+    .reset = gang_rvswd_reset,
+    .write_bits = gang_rvswd_write_bits,
+    .read_bits = gang_rvswd_read_bits,
+    .read_frame = gang_rvswd_read_frame,
+    .delay_us = gang_rvswd_delay_us,
+    .time_us = gang_rvswd_time_us,
+    .match = gang_rvswd_match,
+};
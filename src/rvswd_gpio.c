@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "esp_cpu.h"
+#include "hal/gpio_ll.h"
+#include "rom/ets_sys.h"
+#include "rvswd.h"
+#include "soc/gpio_struct.h"
+
+// Every edge is a single write to the GPIO set/clear registers, gpio_set_level validates its
+// arguments and dispatches through the HAL on every call.
+
+static inline void gpio_rvswd_swdio(rvswd_handle_t* handle, bool level) {
+    gpio_ll_set_level(&GPIO, handle->swdio, level);
+}
+
+static inline void gpio_rvswd_swclk(rvswd_handle_t* handle, bool level) {
+    gpio_ll_set_level(&GPIO, handle->swclk, level);
+}
+
+// Stretch the clock phase to handle->clock_cycles, nothing is added when the clock is not limited
+static inline void gpio_rvswd_half_period(rvswd_handle_t* handle) {
+    if (handle->clock_cycles) {
+        uint32_t start = esp_cpu_get_cycle_count();
+        while (esp_cpu_get_cycle_count() - start < handle->clock_cycles) {
+        }
+    }
+}
+
+static rvswd_result_t gpio_rvswd_init(rvswd_handle_t* handle) {
+    gpio_config_t swio_cfg = {
+        .pin_bit_mask = BIT64(handle->swdio),
+        .mode = GPIO_MODE_INPUT_OUTPUT_OD,
+        .pull_up_en = true,
+        .pull_down_en = false,
+        .intr_type = GPIO_INTR_DISABLE,
+    };
+    esp_err_t res = gpio_config(&swio_cfg);
+    if (res != ESP_OK) {
+        return RVSWD_FAIL;
+    }
+
+    gpio_config_t swck_cfg = {
+        .pin_bit_mask = BIT64(handle->swclk),
+        .mode = GPIO_MODE_OUTPUT,
+        .pull_up_en = false,
+        .pull_down_en = false,
+        .intr_type = GPIO_INTR_DISABLE,
+    };
+    res = gpio_config(&swck_cfg);
+    if (res != ESP_OK) {
+        return RVSWD_FAIL;
+    }
+
+    return RVSWD_OK;
+}
+
+static void gpio_rvswd_start(rvswd_handle_t* handle) {
+    // Start with both lines high
+    gpio_rvswd_swdio(handle, true);
+    gpio_rvswd_swclk(handle, true);
+    ets_delay_us(2);
+
+    // Pull data low
+    gpio_rvswd_swdio(handle, false);
+    ets_delay_us(1);
+
+    // Pull clock low
+    gpio_rvswd_swclk(handle, false);
+    ets_delay_us(1);
+}
+
+static void gpio_rvswd_stop(rvswd_handle_t* handle) {
+    // Pull data low
+    gpio_rvswd_swdio(handle, false);
+    ets_delay_us(1);
+    gpio_rvswd_swclk(handle, true);
+    ets_delay_us(2);
+    // Let data float high
+    gpio_rvswd_swdio(handle, true);
+    ets_delay_us(1);
+}
+
+static void gpio_rvswd_reset(rvswd_handle_t* handle) {
+    gpio_rvswd_swdio(handle, true);
+    ets_delay_us(1);
+    for (uint8_t i = 0; i < 100; i++) {
+        gpio_rvswd_swclk(handle, false);
+        ets_delay_us(1);
+        gpio_rvswd_swclk(handle, true);
+        ets_delay_us(1);
+    }
+    gpio_rvswd_stop(handle);
+}
+
+static void gpio_rvswd_write_bits(rvswd_handle_t* handle, uint32_t bits, uint8_t count) {
+    while (count--) {
+        gpio_rvswd_swdio(handle, (bits >> count) & 1);
+        gpio_rvswd_swclk(handle, false);
+        gpio_rvswd_half_period(handle);
+        gpio_rvswd_swclk(handle, true);  // Data is sampled on rising edge of clock
+        gpio_rvswd_half_period(handle);
+    }
+}
+
+static uint32_t gpio_rvswd_read_bits(rvswd_handle_t* handle, uint8_t count) {
+    uint32_t bits = 0;
+    gpio_rvswd_swdio(handle, true);
+    while (count--) {
+        gpio_rvswd_swclk(handle, false);
+        gpio_rvswd_half_period(handle);
+        gpio_rvswd_swclk(handle, true);  // Data is output on rising edge of clock
+        gpio_rvswd_half_period(handle);  // Sampled late in the phase, a long cable delays the data
+        bits = (bits << 1) | gpio_ll_get_level(&GPIO, handle->swdio);
+    }
+    return bits;
+}
+
+rvswd_transport_t const rvswd_transport_gpio = {
+    .init = gpio_rvswd_init,
+    .start = gpio_rvswd_start,
+    .stop = gpio_rvswd_stop,
+    .reset = gpio_rvswd_reset,
+    .write_bits = gpio_rvswd_write_bits,
+    .read_bits = gpio_rvswd_read_bits,
+};
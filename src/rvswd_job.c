@@ -0,0 +1,112 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "rvswd_job.h"
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/task.h"
+#include "rvswd_ch32v20x.h"
+
+static char const TAG[] = "RVSWD_JOB";
+
+struct rvswd_job {
+    rvswd_job_config_t config;
+    volatile bool cancel;    // Set by rvswd_job_cancel, read by the job task
+    ch32v20x_phase_t phase;  // Phase of the last progress event
+    int64_t last_event_us;   // Time of the last progress event
+    bool reported;           // A progress event was posted
+    uint8_t progress;        // Percentage of the pages of the image passed
+};
+
+static void rvswd_job_post(rvswd_job_t* job, rvswd_job_event_t* event, TickType_t timeout) {
+    event->job = job;
+    event->user_ctx = job->config.user_ctx;
+    xQueueSend(job->config.queue, event, timeout);
+}
+
+// Runs on the job task between pages, so it only posts events and never waits
+static bool rvswd_job_progress(void* ctx, ch32v20x_phase_t phase, uint32_t addr, size_t index, size_t total) {
+    rvswd_job_t* job = ctx;
+    if (job->cancel) {
+        return false;
+    }
+    if (phase == CH32V20X_PHASE_DONE) {
+        job->progress = 100;
+    } else if (total) {
+        job->progress = index * 100 / total;
+    }
+
+    int64_t now = rvswd_time_us(job->config.handle);
+    if (job->reported && phase == job->phase && now - job->last_event_us < (int64_t)job->config.interval_ms * 1000) {
+        return true;
+    }
+    job->reported = true;
+    job->phase = phase;
+    job->last_event_us = now;
+
+    rvswd_job_event_t event = {
+        .type = RVSWD_JOB_PROGRESS,
+        .phase = phase,
+        .addr = addr,
+        .progress = job->progress,
+    };
+    rvswd_job_post(job, &event, 0);
+    return true;
+}
+
+static void rvswd_job_task(void* arg) {
+    rvswd_job_t* job = arg;
+    rvswd_job_event_t event = {
+        .type = RVSWD_JOB_DONE,
+        .phase = CH32V20X_PHASE_DONE,
+    };
+    event.success = ch32v20x_program_source_ex(job->config.handle, &job->config.firmware, job->config.flags,
+                                               rvswd_job_progress, job, &event.stats);
+    event.cancelled = job->cancel && !event.success;
+    event.progress = event.success ? 100 : job->progress;
+
+    // The receiver may free the job as soon as the event is in the queue
+    rvswd_job_post(job, &event, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+rvswd_job_t* rvswd_job_start(rvswd_job_config_t const* config) {
+    if (config->handle == NULL || config->queue == NULL) {
+        return NULL;
+    }
+
+    rvswd_job_t* job = calloc(1, sizeof(rvswd_job_t));
+    if (job == NULL) {
+        return NULL;
+    }
+    job->config = *config;
+    if (job->config.stack_size == 0) {
+        job->config.stack_size = RVSWD_JOB_DEFAULT_STACK_SIZE;
+    }
+    if (job->config.priority == 0) {
+        job->config.priority = RVSWD_JOB_DEFAULT_PRIORITY;
+    }
+    if (job->config.interval_ms == 0) {
+        job->config.interval_ms = RVSWD_JOB_DEFAULT_INTERVAL_MS;
+    }
+
+    if (xTaskCreatePinnedToCore(rvswd_job_task, "rvswd_job", job->config.stack_size, job, job->config.priority, NULL,
+                                job->config.pin_to_core ? job->config.core : tskNO_AFFINITY) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the job task");
+        free(job);
+        return NULL;
+    }
+    return job;
+}
+
+void rvswd_job_cancel(rvswd_job_t* job) {
+    job->cancel = true;
+}
+
+void rvswd_job_free(rvswd_job_t* job) {
+    free(job);
+}
@@ -0,0 +1,129 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "rvswd_lzss.h"
+#include <stdint.h>
+#include <string.h>
+#include "rvswd_source.h"
+
+static void rvswd_lzss_restart(rvswd_lzss_t* lzss) {
+    lzss->input_offset = RVSWD_LZSS_HEADER_SIZE;
+    lzss->input_length = 0;
+    lzss->input_position = 0;
+    lzss->output_offset = 0;
+    lzss->copy_distance = 0;
+    lzss->copy_length = 0;
+    lzss->flags = 0;
+    lzss->flags_left = 0;
+}
+
+static bool rvswd_lzss_input(rvswd_lzss_t* lzss, uint8_t* byte) {
+    if (lzss->input_position == lzss->input_length) {
+        lzss->input_offset += lzss->input_length;
+        size_t length = lzss->input->length - lzss->input_offset;
+        if (length > RVSWD_LZSS_INPUT_CHUNK) {
+            length = RVSWD_LZSS_INPUT_CHUNK;
+        }
+        if (length == 0 || !rvswd_source_read(lzss->input, lzss->input_offset, lzss->input_buffer, length)) {
+            return false;
+        }
+        lzss->input_length = length;
+        lzss->input_position = 0;
+    }
+    *byte = lzss->input_buffer[lzss->input_position++];
+    return true;
+}
+
+static bool rvswd_lzss_input_u16(rvswd_lzss_t* lzss, uint16_t* value) {
+    uint8_t low;
+    uint8_t high;
+    if (!rvswd_lzss_input(lzss, &low) || !rvswd_lzss_input(lzss, &high)) {
+        return false;
+    }
+    *value = low | (high << 8);
+    return true;
+}
+
+// Decode the next byte of the image
+static bool rvswd_lzss_next(rvswd_lzss_t* lzss, uint8_t* byte) {
+    if (lzss->copy_length == 0) {
+        if (lzss->flags_left == 0) {
+            if (!rvswd_lzss_input(lzss, &lzss->flags)) {
+                return false;
+            }
+            lzss->flags_left = 8;
+        }
+        bool literal = lzss->flags & 1;
+        lzss->flags >>= 1;
+        lzss->flags_left--;
+
+        if (literal) {
+            if (!rvswd_lzss_input(lzss, byte)) {
+                return false;
+            }
+            lzss->window[lzss->output_offset++ % RVSWD_LZSS_WINDOW] = *byte;
+            return true;
+        }
+
+        uint16_t token;
+        if (!rvswd_lzss_input_u16(lzss, &token)) {
+            return false;
+        }
+        lzss->copy_distance = token >> 4;
+        lzss->copy_length = (token & 0xF) + RVSWD_LZSS_MIN_MATCH;
+        if (lzss->copy_distance == 0 && !rvswd_lzss_input_u16(lzss, &lzss->copy_length)) {
+            return false;
+        }
+        if (lzss->copy_length == 0 || lzss->copy_distance > lzss->output_offset) {
+            return false;  // Corrupt container
+        }
+    }
+
+    if (lzss->copy_distance) {
+        *byte = lzss->window[(lzss->output_offset - lzss->copy_distance) % RVSWD_LZSS_WINDOW];
+    } else {
+        *byte = 0xFF;
+    }
+    lzss->copy_length--;
+    lzss->window[lzss->output_offset++ % RVSWD_LZSS_WINDOW] = *byte;
+    return true;
+}
+
+static bool rvswd_lzss_read(void* ctx, size_t offset, void* buffer, size_t length) {
+    rvswd_lzss_t* lzss = ctx;
+    if (offset < lzss->output_offset) {
+        rvswd_lzss_restart(lzss);
+    }
+
+    uint8_t byte;
+    while (lzss->output_offset < offset) {
+        if (!rvswd_lzss_next(lzss, &byte)) {
+            return false;
+        }
+    }
+
+    uint8_t* output = buffer;
+    for (size_t i = 0; i < length; i++) {
+        if (!rvswd_lzss_next(lzss, &output[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool rvswd_source_lzss(rvswd_source_t* source, rvswd_lzss_t* lzss, rvswd_source_t const* input) {
+    uint32_t header[2];
+    if (!rvswd_source_read(input, 0, header, sizeof(header)) || header[0] != RVSWD_LZSS_MAGIC) {
+        return false;
+    }
+
+    lzss->input = input;
+    rvswd_lzss_restart(lzss);
+    source->read = rvswd_lzss_read;
+    source->ctx = lzss;
+    source->length = header[1];
+    return true;
+}
@@ -0,0 +1,87 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "rvswd_mock.h"
+#include <stdint.h>
+#include "rvswd.h"
+
+static bool mock_rvswd_clock(rvswd_handle_t* handle, bool swdio) {
+    rvswd_mock_t* mock = handle->transport_ctx;
+    uint32_t period_ns = mock->clock_ns;
+    if (handle->clock_hz && 1000000000 / handle->clock_hz > period_ns) {
+        period_ns = 1000000000 / handle->clock_hz;
+    }
+    mock->clocks++;
+    mock->clocked_ns += period_ns;
+    if (mock->clock == NULL) {
+        return swdio;  // Nothing drives the line, the pull-up keeps a released line high
+    }
+    return mock->clock(mock->user, swdio);
+}
+
+static rvswd_result_t mock_rvswd_init(rvswd_handle_t* handle) {
+    if (handle->transport_ctx == NULL) {
+        return RVSWD_INVALID_ARGS;
+    }
+    return RVSWD_OK;
+}
+
+static void mock_rvswd_start(rvswd_handle_t* handle) {
+    rvswd_mock_t* mock = handle->transport_ctx;
+    mock->frames++;
+    if (mock->start) {
+        mock->start(mock->user);
+    }
+}
+
+static void mock_rvswd_stop(rvswd_handle_t* handle) {
+    rvswd_mock_t* mock = handle->transport_ctx;
+    if (mock->stop) {
+        mock->stop(mock->user);
+    }
+}
+
+static void mock_rvswd_reset(rvswd_handle_t* handle) {
+    for (uint8_t i = 0; i < 100; i++) {
+        mock_rvswd_clock(handle, true);
+    }
+    mock_rvswd_stop(handle);
+}
+
+static void mock_rvswd_write_bits(rvswd_handle_t* handle, uint32_t bits, uint8_t count) {
+    while (count--) {
+        mock_rvswd_clock(handle, (bits >> count) & 1);
+    }
+}
+
+static uint32_t mock_rvswd_read_bits(rvswd_handle_t* handle, uint8_t count) {
+    uint32_t bits = 0;
+    while (count--) {
+        bits = (bits << 1) | mock_rvswd_clock(handle, true);
+    }
+    return bits;
+}
+
+static void mock_rvswd_delay_us(rvswd_handle_t* handle, uint32_t us) {
+    rvswd_mock_t* mock = handle->transport_ctx;
+    mock->delayed_us += us;
+}
+
+static int64_t mock_rvswd_time_us(rvswd_handle_t* handle) {
+    rvswd_mock_t* mock = handle->transport_ctx;
+    return mock->clocked_ns / 1000 + mock->delayed_us;
+}
+
+rvswd_transport_t const rvswd_transport_mock = {
+    .init = mock_rvswd_init,
+    .start = mock_rvswd_start,
+    .stop = mock_rvswd_stop,
+    .reset = mock_rvswd_reset,
+    .write_bits = mock_rvswd_write_bits,
+    .read_bits = mock_rvswd_read_bits,
+    .delay_us = mock_rvswd_delay_us,
+    .time_us = mock_rvswd_time_us,
+};
@@ -0,0 +1,1050 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "rvswd_sim.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rvswd.h"
+#include "rvswd_frame.h"
+#include "rvswd_gang.h"
+#include "rvswd_mock.h"
+
+// Debug module registers
+#define SIM_DATA0        0x04
+#define SIM_DATA1        0x05
+#define SIM_DMCONTROL    0x10
+#define SIM_DMSTATUS     0x11
+#define SIM_HARTINFO     0x12
+#define SIM_ABSTRACTCS   0x16
+#define SIM_COMMAND      0x17
+#define SIM_ABSTRACTAUTO 0x18
+#define SIM_PROGBUF0     0x20
+#define SIM_PROGBUF7     0x27
+
+#define SIM_CMDERR_BUSY       1
+#define SIM_CMDERR_NOTSUP     2
+#define SIM_CMDERR_EXCEPTION  3
+#define SIM_CMDERR_HALTRESUME 4
+
+// Memory map
+#define SIM_FLASH_BASE   0x08000000
+#define SIM_SRAM_BASE    0x20000000
+#define SIM_FLASH_REGS   0x40022000
+#define SIM_CHIP_ID      0x1FFFF704
+#define SIM_ESIG_FLACAP  0x1FFFF7E0
+#define SIM_OPTION_BYTES 0x1FFFF800
+#define SIM_PROGBUF_ADDR 0xE0000380
+
+#define SIM_PAGE_SIZE 256
+#define SIM_KEY1      0x45670123
+#define SIM_KEY2      0xCDEF89AB
+
+// Flash controller bits, shared by the CH32V20x and CH32X035
+#define SIM_STATR_BSY      (1 << 0)
+#define SIM_STATR_WRBUSY   (1 << 1)
+#define SIM_STATR_WRPRTERR (1 << 4)
+#define SIM_STATR_EOP      (1 << 5)
+#define SIM_CTLR_PG        (1 << 0)
+#define SIM_CTLR_PER       (1 << 1)
+#define SIM_CTLR_MER       (1 << 2)
+#define SIM_CTLR_STRT      (1 << 6)
+#define SIM_CTLR_LOCK      (1 << 7)
+#define SIM_CTLR_FLOCK     (1 << 15)
+#define SIM_CTLR_FTPG      (1 << 16)
+#define SIM_CTLR_FTER      (1 << 17)
+#define SIM_CTLR_BUFLOAD   (1 << 18)
+#define SIM_CTLR_BUFRST    (1 << 19)
+#define SIM_CTLR_PGSTRT    (1 << 21)
+#define SIM_CTLR_BER32     (1 << 23)
+
+#define SIM_CPU_NS    7        // Duration of a single instruction
+#define SIM_MAX_STEPS 5000000  // Give up on programs that do not terminate
+
+rvswd_sim_config_t const rvswd_sim_ch32v203 = {
+    .chip_id = 0x20310500,
+    .flash_size = 64 * 1024,
+    .sram_size = 20 * 1024,
+    .erased_value = 0xE339E339,
+    .clock_ns = 250,
+    .page_erase_us = 2000,
+    .sector_erase_us = 6000,
+    .mass_erase_us = 20000,
+    .page_program_us = 1500,
+};
+
+rvswd_sim_config_t const rvswd_sim_ch32x035 = {
+    .chip_id = 0x03500601,
+    .flash_size = 62 * 1024,
+    .sram_size = 20 * 1024,
+    .erased_value = 0xFFFFFFFF,
+    .clock_ns = 250,
+    .page_erase_us = 2000,
+    .sector_erase_us = 10000,
+    .mass_erase_us = 20000,
+    .page_program_us = 1500,
+};
+
+struct rvswd_sim {
+    rvswd_sim_config_t config;
+    rvswd_mock_t mock;
+
+    // Wire
+    bool active;        // Between a start and a stop condition
+    bool reading;       // The current frame is a read
+    uint8_t bit;        // Position within the current frame
+    uint64_t shift;     // Bits received in the current frame
+    uint32_t response;  // Value returned by the current read frame
+    bool parity;        // Parity returned by the current read frame
+    uint32_t error_rate;
+    uint32_t random;
+    rvswd_handle_t* handle;
+    uint32_t max_clock_hz;  // Bits flip on the wire above this clock
+    uint32_t drop_rate;
+
+    // Time
+    uint64_t exec_ns;   // Time of the instruction being executed, 0 when the wire drives the time
+    uint64_t abstract_busy_until;
+
+    // Debug module
+    uint32_t data[2];
+    uint32_t dmcontrol;
+    uint32_t command;
+    uint32_t abstractauto;
+    uint32_t cmderr;
+    uint32_t progbuf[8];
+
+    // Hart
+    bool halted;
+    bool havereset;
+    bool resumeack;
+    uint32_t x[32];
+    uint32_t dpc;
+    uint32_t dcsr;
+
+    // Memory
+    uint8_t* flash;
+    uint8_t* sram;
+    bool* page_erased;
+    uint32_t option_bytes[4];
+
+    // Flash controller
+    uint32_t ctlr;
+    uint32_t addr;
+    uint32_t statr;
+    uint8_t key_state;
+    uint8_t mode_key_state;
+    bool locked;
+    bool fast_locked;
+    uint64_t busy_until;
+    uint32_t page_buffer[SIM_PAGE_SIZE / 4];
+};
+
+uint64_t rvswd_sim_time_ns(rvswd_sim_t* sim) {
+    if (sim->exec_ns) {
+        return sim->exec_ns;
+    }
+    return sim->mock.clocked_ns + sim->mock.delayed_us * 1000;
+}
+
+uint64_t rvswd_sim_time_us(rvswd_sim_t* sim) {
+    return rvswd_sim_time_ns(sim) / 1000;
+}
+
+uint8_t* rvswd_sim_flash(rvswd_sim_t* sim) {
+    return sim->flash;
+}
+
+void rvswd_sim_set_error_rate(rvswd_sim_t* sim, uint32_t rate) {
+    sim->error_rate = rate;
+}
+
+void rvswd_sim_set_drop_rate(rvswd_sim_t* sim, uint32_t rate) {
+    sim->drop_rate = rate;
+}
+
+void rvswd_sim_set_max_clock(rvswd_sim_t* sim, uint32_t hz) {
+    sim->max_clock_hz = hz;
+}
+
+static bool sim_random(rvswd_sim_t* sim, uint32_t rate) {
+    sim->random = sim->random * 1103515245 + 12345;
+    return (sim->random >> 8) % rate == 0;
+}
+
+// Flip a bit now and then when the clock is faster than the wiring allows
+static bool sim_wire(rvswd_sim_t* sim, bool level) {
+    if (sim->max_clock_hz == 0) {
+        return level;
+    }
+    uint32_t hz = sim->handle->clock_hz ? sim->handle->clock_hz : 1000000000 / sim->config.clock_ns;
+    if (hz > sim->max_clock_hz && sim_random(sim, 32)) {
+        return !level;
+    }
+    return level;
+}
+
+// Flash controller
+
+static bool sim_flash_busy(rvswd_sim_t* sim) {
+    return rvswd_sim_time_ns(sim) < sim->busy_until;
+}
+
+static void sim_flash_start(rvswd_sim_t* sim, uint32_t duration_us) {
+    sim->busy_until = rvswd_sim_time_ns(sim) + (uint64_t)duration_us * 1000;
+    sim->statr |= SIM_STATR_EOP;
+}
+
+static void sim_flash_erase(rvswd_sim_t* sim, uint32_t address, uint32_t size, uint32_t duration_us) {
+    uint32_t offset = (address - SIM_FLASH_BASE) & ~(size - 1);
+    if (address < SIM_FLASH_BASE || offset >= sim->config.flash_size) {
+        sim->statr |= SIM_STATR_WRPRTERR;
+        return;
+    }
+    if (offset + size > sim->config.flash_size) {
+        size = sim->config.flash_size - offset;
+    }
+    for (uint32_t i = 0; i < size; i += 4) {
+        memcpy(&sim->flash[offset + i], &sim->config.erased_value, 4);
+    }
+    for (uint32_t i = 0; i < size; i += SIM_PAGE_SIZE) {
+        sim->page_erased[(offset + i) / SIM_PAGE_SIZE] = true;
+    }
+    sim_flash_start(sim, duration_us);
+}
+
+static void sim_flash_program_page(rvswd_sim_t* sim) {
+    uint32_t offset = (sim->addr - SIM_FLASH_BASE) & ~(SIM_PAGE_SIZE - 1);
+    if (sim->addr < SIM_FLASH_BASE || offset >= sim->config.flash_size) {
+        sim->statr |= SIM_STATR_WRPRTERR;
+        return;
+    }
+    bool erased = sim->page_erased[offset / SIM_PAGE_SIZE];
+    for (uint32_t i = 0; i < SIM_PAGE_SIZE / 4; i++) {
+        uint32_t word;
+        memcpy(&word, &sim->flash[offset + i * 4], 4);
+        // Programming a page that was not erased first corrupts it
+        word = erased ? sim->page_buffer[i] : (word ^ sim->page_buffer[i]);
+        memcpy(&sim->flash[offset + i * 4], &word, 4);
+    }
+    sim->page_erased[offset / SIM_PAGE_SIZE] = false;
+    sim_flash_start(sim, sim->config.page_program_us);
+}
+
+static void sim_flash_write_ctlr(rvswd_sim_t* sim, uint32_t value) {
+    if (sim->locked) {
+        return;
+    }
+    if (value & SIM_CTLR_LOCK) {
+        sim->locked = true;
+        sim->fast_locked = true;
+        sim->ctlr = 0;
+        return;
+    }
+    if (sim_flash_busy(sim)) {
+        sim->statr |= SIM_STATR_WRPRTERR;
+        return;
+    }
+    bool fast = value & (SIM_CTLR_FTPG | SIM_CTLR_FTER);
+    if (fast && sim->fast_locked) {
+        sim->statr |= SIM_STATR_WRPRTERR;
+        return;
+    }
+
+    sim->ctlr = value & ~(SIM_CTLR_STRT | SIM_CTLR_PGSTRT | SIM_CTLR_BUFLOAD | SIM_CTLR_BUFRST);
+
+    if (value & SIM_CTLR_BUFRST) {
+        memset(sim->page_buffer, 0xFF, sizeof(sim->page_buffer));
+    }
+    if ((value & SIM_CTLR_FTPG) && (value & (SIM_CTLR_PGSTRT | SIM_CTLR_STRT))) {
+        sim_flash_program_page(sim);
+    } else if (value & SIM_CTLR_STRT) {
+        if (value & SIM_CTLR_FTER) {
+            sim_flash_erase(sim, sim->addr, SIM_PAGE_SIZE, sim->config.page_erase_us);
+        } else if (value & SIM_CTLR_BER32) {
+            sim_flash_erase(sim, sim->addr, 32 * 1024, sim->config.sector_erase_us);
+        } else if (value & SIM_CTLR_PER) {
+            sim_flash_erase(sim, sim->addr, sim->config.chip_id >> 24 == 0x20 ? 4096 : 1024,
+                            sim->config.sector_erase_us);
+        } else if (value & SIM_CTLR_MER) {
+            sim_flash_erase(sim, SIM_FLASH_BASE, sim->config.flash_size, sim->config.mass_erase_us);
+        }
+    }
+}
+
+static uint32_t sim_key(uint8_t* state, uint32_t value) {
+    if (*state == 0 && value == SIM_KEY1) {
+        *state = 1;
+    } else if (*state == 1 && value == SIM_KEY2) {
+        *state = 2;
+    } else {
+        *state = 0;
+    }
+    return *state == 2;
+}
+
+static bool sim_flash_regs_store(rvswd_sim_t* sim, uint32_t offset, uint32_t value) {
+    switch (offset) {
+        case 0x04:
+            if (sim_key(&sim->key_state, value)) {
+                sim->locked = false;
+                sim->key_state = 0;
+            }
+            return true;
+        case 0x08:
+            return true;
+        case 0x0C:
+            sim->statr &= ~(value & (SIM_STATR_EOP | SIM_STATR_WRPRTERR));
+            return true;
+        case 0x10:
+            sim_flash_write_ctlr(sim, value);
+            return true;
+        case 0x14:
+            sim->addr = value;
+            return true;
+        case 0x24:
+            if (!sim->locked && sim_key(&sim->mode_key_state, value)) {
+                sim->fast_locked = false;
+                sim->mode_key_state = 0;
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+static uint32_t sim_flash_regs_load(rvswd_sim_t* sim, uint32_t offset) {
+    switch (offset) {
+        case 0x0C:
+            return sim->statr | (sim_flash_busy(sim) ? SIM_STATR_BSY : 0);
+        case 0x10:
+            return sim->ctlr | (sim->locked ? SIM_CTLR_LOCK : 0) | (sim->fast_locked ? SIM_CTLR_FLOCK : 0);
+        case 0x14:
+            return sim->addr;
+        default:
+            return 0;
+    }
+}
+
+// Memory
+
+static bool sim_load(rvswd_sim_t* sim, uint32_t address, uint8_t size, uint32_t* value) {
+    uint8_t const* base = NULL;
+    *value = 0;
+    if (address >= SIM_FLASH_BASE && address + size <= SIM_FLASH_BASE + sim->config.flash_size) {
+        base = &sim->flash[address - SIM_FLASH_BASE];
+    } else if (address >= SIM_SRAM_BASE && address + size <= SIM_SRAM_BASE + sim->config.sram_size) {
+        base = &sim->sram[address - SIM_SRAM_BASE];
+    } else if (address >= SIM_OPTION_BYTES && address + size <= SIM_OPTION_BYTES + sizeof(sim->option_bytes)) {
+        base = (uint8_t const*)sim->option_bytes + (address - SIM_OPTION_BYTES);
+    } else if (address >= SIM_PROGBUF_ADDR && address + size <= SIM_PROGBUF_ADDR + sizeof(sim->progbuf)) {
+        base = (uint8_t const*)sim->progbuf + (address - SIM_PROGBUF_ADDR);
+    } else if (size == 4 && address == SIM_CHIP_ID) {
+        *value = sim->config.chip_id;
+        return true;
+    } else if (size == 4 && address == SIM_ESIG_FLACAP) {
+        *value = 0xFFFF0000 | (sim->config.flash_size / 1024);
+        return true;
+    } else if (size == 4 && address >= SIM_FLASH_REGS && address < SIM_FLASH_REGS + 0x400) {
+        *value = sim_flash_regs_load(sim, address - SIM_FLASH_REGS);
+        return true;
+    } else {
+        return false;
+    }
+    memcpy(value, base, size);
+    return true;
+}
+
+static bool sim_store(rvswd_sim_t* sim, uint32_t address, uint8_t size, uint32_t value) {
+    if (address >= SIM_FLASH_BASE && address + size <= SIM_FLASH_BASE + sim->config.flash_size) {
+        if (size != 4 || !(sim->ctlr & SIM_CTLR_FTPG) || sim->locked) {
+            sim->statr |= SIM_STATR_WRPRTERR;
+            return true;
+        }
+        sim->page_buffer[(address % SIM_PAGE_SIZE) / 4] = value;
+        return true;
+    } else if (address >= SIM_SRAM_BASE && address + size <= SIM_SRAM_BASE + sim->config.sram_size) {
+        memcpy(&sim->sram[address - SIM_SRAM_BASE], &value, size);
+        return true;
+    } else if (size == 4 && address >= SIM_FLASH_REGS && address < SIM_FLASH_REGS + 0x400) {
+        return sim_flash_regs_store(sim, address - SIM_FLASH_REGS, value);
+    }
+    return false;
+}
+
+// Hart, executes RV32IC code in debug mode until an ebreak
+
+static int32_t sim_sext(uint32_t value, uint8_t bits) {
+    return (int32_t)(value << (32 - bits)) >> (32 - bits);
+}
+
+static void sim_set_reg(rvswd_sim_t* sim, uint8_t reg, uint32_t value) {
+    if (reg) {
+        sim->x[reg] = value;
+    }
+}
+
+// Expand a compressed instruction into its 32 bit equivalent, returns 0 for unsupported instructions
+static uint32_t sim_expand(uint16_t c) {
+    uint8_t op = c & 3;
+    uint8_t funct3 = c >> 13;
+    uint8_t rd = (c >> 7) & 0x1F;
+    uint8_t rs2 = (c >> 2) & 0x1F;
+    uint8_t rdp = 8 + ((c >> 2) & 7);
+    uint8_t rs1p = 8 + ((c >> 7) & 7);
+    uint32_t imm;
+
+    if (op == 0) {
+        uint32_t offset = ((c >> 7) & 0x38) | ((c << 1) & 0x40) | ((c >> 4) & 0x4);
+        if (funct3 == 2) {  // c.lw
+            return (offset << 20) | (rs1p << 15) | (2 << 12) | (rdp << 7) | 0x03;
+        }
+        if (funct3 == 6) {  // c.sw
+            return ((offset >> 5) << 25) | (rdp << 20) | (rs1p << 15) | (2 << 12) | ((offset & 0x1F) << 7) | 0x23;
+        }
+        if (funct3 == 0 && c != 0) {  // c.addi4spn
+            imm = ((c >> 1) & 0x3C0) | ((c >> 7) & 0x30) | ((c >> 2) & 0x8) | ((c >> 4) & 0x4);
+            return (imm << 20) | (2 << 15) | (rdp << 7) | 0x13;
+        }
+        return 0;
+    }
+
+    if (op == 1) {
+        imm = sim_sext(((c >> 7) & 0x20) | ((c >> 2) & 0x1F), 6);
+        switch (funct3) {
+            case 0:  // c.addi
+                return (imm << 20) | (rd << 15) | (rd << 7) | 0x13;
+            case 1:  // c.jal
+            case 5: {  // c.j
+                uint32_t j = ((c >> 1) & 0x800) | ((c << 2) & 0x400) | ((c >> 1) & 0x300) | ((c << 1) & 0x80) |
+                             ((c >> 1) & 0x40) | ((c << 3) & 0x20) | ((c >> 7) & 0x10) | ((c >> 2) & 0xE);
+                j = sim_sext(j, 12);
+                uint32_t encoded = ((j >> 20) & 1) << 31 | ((j >> 1) & 0x3FF) << 21 | ((j >> 11) & 1) << 20 |
+                                   ((j >> 12) & 0xFF) << 12;
+                return encoded | ((funct3 == 1) ? (1 << 7) : 0) | 0x6F;
+            }
+            case 2:  // c.li
+                return (imm << 20) | (rd << 7) | 0x13;
+            case 3:
+                if (rd == 2) {  // c.addi16sp
+                    imm = sim_sext(((c >> 3) & 0x200) | ((c >> 2) & 0x10) | ((c << 1) & 0x40) | ((c << 4) & 0x180) |
+                                       ((c << 3) & 0x20),
+                                   10);
+                    return (imm << 20) | (2 << 15) | (2 << 7) | 0x13;
+                }
+                return (imm << 12) | (rd << 7) | 0x37;  // c.lui
+            case 4: {
+                uint8_t funct2 = (c >> 10) & 3;
+                if (funct2 == 0) {  // c.srli
+                    return ((imm & 0x1F) << 20) | (rs1p << 15) | (5 << 12) | (rs1p << 7) | 0x13;
+                }
+                if (funct2 == 1) {  // c.srai
+                    return (0x20 << 25) | ((imm & 0x1F) << 20) | (rs1p << 15) | (5 << 12) | (rs1p << 7) | 0x13;
+                }
+                if (funct2 == 2) {  // c.andi
+                    return (imm << 20) | (rs1p << 15) | (7 << 12) | (rs1p << 7) | 0x13;
+                }
+                uint8_t rs2p = 8 + ((c >> 2) & 7);
+                static uint8_t const funct3s[] = {0, 4, 6, 7};  // sub, xor, or, and
+                uint8_t sel = (c >> 5) & 3;
+                return ((sel == 0) ? (0x20 << 25) : 0) | (rs2p << 20) | (rs1p << 15) | (funct3s[sel] << 12) |
+                       (rs1p << 7) | 0x33;
+            }
+            case 6:    // c.beqz
+            case 7: {  // c.bnez
+                uint32_t b = ((c >> 4) & 0x100) | ((c << 1) & 0xC0) | ((c << 3) & 0x20) | ((c >> 7) & 0x18) |
+                             ((c >> 2) & 0x6);
+                b = sim_sext(b, 9);
+                return (((b >> 12) & 1) << 31) | (((b >> 5) & 0x3F) << 25) | (rs1p << 15) |
+                       ((funct3 == 6 ? 0 : 1) << 12) | (((b >> 1) & 0xF) << 8) | (((b >> 11) & 1) << 7) | 0x63;
+            }
+        }
+        return 0;
+    }
+
+    if (op == 2) {
+        switch (funct3) {
+            case 0:  // c.slli
+                return ((rs2 | ((c >> 7) & 0x20)) << 20) | (rd << 15) | (1 << 12) | (rd << 7) | 0x13;
+            case 2: {  // c.lwsp
+                uint32_t offset = ((c >> 7) & 0x20) | ((c >> 2) & 0x1C) | ((c << 4) & 0xC0);
+                return (offset << 20) | (2 << 15) | (2 << 12) | (rd << 7) | 0x03;
+            }
+            case 4:
+                if (!(c & 0x1000)) {
+                    if (rs2 == 0) {  // c.jr
+                        return (rd << 15) | 0x67;
+                    }
+                    return (rs2 << 20) | (rd << 7) | 0x33;  // c.mv
+                }
+                if (rd == 0 && rs2 == 0) {  // c.ebreak
+                    return 0x00100073;
+                }
+                if (rs2 == 0) {  // c.jalr
+                    return (rd << 15) | (1 << 7) | 0x67;
+                }
+                return (rs2 << 20) | (rd << 15) | (rd << 7) | 0x33;  // c.add
+            case 6: {  // c.swsp
+                uint32_t offset = ((c >> 7) & 0x3C) | ((c >> 1) & 0xC0);
+                return ((offset >> 5) << 25) | (rs2 << 20) | (2 << 15) | (2 << 12) | ((offset & 0x1F) << 7) | 0x23;
+            }
+        }
+    }
+    return 0;
+}
+
+// Execute a single instruction, returns false on ebreak or exceptions
+static bool sim_step(rvswd_sim_t* sim, uint32_t* pc, bool* exception) {
+    uint32_t instruction;
+    uint8_t length = 4;
+    if (!sim_load(sim, *pc, 2, &instruction)) {
+        *exception = true;
+        return false;
+    }
+    if ((instruction & 3) != 3) {
+        instruction = sim_expand(instruction);
+        length = 2;
+    } else if (!sim_load(sim, *pc, 4, &instruction)) {
+        *exception = true;
+        return false;
+    }
+    sim->exec_ns += SIM_CPU_NS;
+
+    uint8_t opcode = instruction & 0x7F;
+    uint8_t rd = (instruction >> 7) & 0x1F;
+    uint8_t funct3 = (instruction >> 12) & 7;
+    uint32_t rs1 = sim->x[(instruction >> 15) & 0x1F];
+    uint32_t rs2 = sim->x[(instruction >> 20) & 0x1F];
+    int32_t imm_i = (int32_t)instruction >> 20;
+    int32_t imm_s = ((int32_t)instruction >> 25 << 5) | ((instruction >> 7) & 0x1F);
+    uint32_t next = *pc + length;
+    uint32_t value;
+
+    switch (opcode) {
+        case 0x37:  // lui
+            sim_set_reg(sim, rd, instruction & 0xFFFFF000);
+            break;
+        case 0x17:  // auipc
+            sim_set_reg(sim, rd, *pc + (instruction & 0xFFFFF000));
+            break;
+        case 0x6F: {  // jal
+            int32_t offset = sim_sext(((instruction >> 11) & 0x100000) | (instruction & 0xFF000) |
+                                          ((instruction >> 9) & 0x800) | ((instruction >> 20) & 0x7FE),
+                                      21);
+            sim_set_reg(sim, rd, next);
+            next = *pc + offset;
+            break;
+        }
+        case 0x67:  // jalr
+            value = (rs1 + imm_i) & ~1u;
+            sim_set_reg(sim, rd, next);
+            next = value;
+            break;
+        case 0x63: {  // branches
+            int32_t offset = sim_sext(((instruction >> 19) & 0x1000) | ((instruction << 4) & 0x800) |
+                                          ((instruction >> 20) & 0x7E0) | ((instruction >> 7) & 0x1E),
+                                      13);
+            bool taken;
+            switch (funct3) {
+                case 0:
+                    taken = rs1 == rs2;
+                    break;
+                case 1:
+                    taken = rs1 != rs2;
+                    break;
+                case 4:
+                    taken = (int32_t)rs1 < (int32_t)rs2;
+                    break;
+                case 5:
+                    taken = (int32_t)rs1 >= (int32_t)rs2;
+                    break;
+                case 6:
+                    taken = rs1 < rs2;
+                    break;
+                case 7:
+                    taken = rs1 >= rs2;
+                    break;
+                default:
+                    *exception = true;
+                    return false;
+            }
+            if (taken) {
+                next = *pc + offset;
+            }
+            break;
+        }
+        case 0x03: {  // loads
+            static uint8_t const sizes[] = {1, 2, 4, 0, 1, 2, 0, 0};
+            if (!sizes[funct3] || !sim_load(sim, rs1 + imm_i, sizes[funct3], &value)) {
+                *exception = true;
+                return false;
+            }
+            if (funct3 == 0) value = (int8_t)value;
+            if (funct3 == 1) value = (int16_t)value;
+            sim_set_reg(sim, rd, value);
+            break;
+        }
+        case 0x23: {  // stores
+            static uint8_t const sizes[] = {1, 2, 4, 0, 0, 0, 0, 0};
+            if (!sizes[funct3] || !sim_store(sim, rs1 + imm_s, sizes[funct3], rs2)) {
+                *exception = true;
+                return false;
+            }
+            break;
+        }
+        case 0x13:    // op-imm
+        case 0x33: {  // op
+            bool reg = opcode == 0x33;
+            uint32_t b = reg ? rs2 : (uint32_t)imm_i;
+            bool alt = (instruction >> 30) & 1;
+            if (reg && (instruction >> 25) == 1) {  // M extension, only multiplication
+                value = rs1 * rs2;
+            } else {
+                switch (funct3) {
+                    case 0:
+                        value = (reg && alt) ? rs1 - b : rs1 + b;
+                        break;
+                    case 1:
+                        value = rs1 << (b & 0x1F);
+                        break;
+                    case 2:
+                        value = (int32_t)rs1 < (int32_t)b;
+                        break;
+                    case 3:
+                        value = rs1 < b;
+                        break;
+                    case 4:
+                        value = rs1 ^ b;
+                        break;
+                    case 5:
+                        value = alt ? (uint32_t)((int32_t)rs1 >> (b & 0x1F)) : rs1 >> (b & 0x1F);
+                        break;
+                    case 6:
+                        value = rs1 | b;
+                        break;
+                    default:
+                        value = rs1 & b;
+                        break;
+                }
+            }
+            sim_set_reg(sim, rd, value);
+            break;
+        }
+        case 0x73:  // ebreak
+            return false;
+        default:
+            *exception = true;
+            return false;
+    }
+    *pc = next;
+    return true;
+}
+
+static bool sim_run_progbuf(rvswd_sim_t* sim) {
+    uint32_t pc = SIM_PROGBUF_ADDR;
+    bool exception = false;
+    sim->exec_ns = rvswd_sim_time_ns(sim);
+    for (uint32_t steps = 0; steps < SIM_MAX_STEPS; steps++) {
+        if (pc == SIM_PROGBUF_ADDR + sizeof(sim->progbuf)) {
+            break;  // Implicit ebreak after the last program buffer word
+        }
+        if (!sim_step(sim, &pc, &exception)) {
+            break;
+        }
+    }
+    sim->abstract_busy_until = sim->exec_ns;
+    sim->exec_ns = 0;
+    return !exception;
+}
+
+// Debug module
+
+static bool sim_abstract_busy(rvswd_sim_t* sim) {
+    return rvswd_sim_time_ns(sim) < sim->abstract_busy_until;
+}
+
+static void sim_execute_command(rvswd_sim_t* sim) {
+    if (sim->cmderr) {
+        return;
+    }
+    if (sim_abstract_busy(sim)) {
+        sim->cmderr = SIM_CMDERR_BUSY;
+        return;
+    }
+    if (!sim->halted) {
+        sim->cmderr = SIM_CMDERR_HALTRESUME;
+        return;
+    }
+    uint32_t command = sim->command;
+    if ((command >> 24) != 0 || ((command >> 20) & 7) != 2) {
+        sim->cmderr = SIM_CMDERR_NOTSUP;
+        return;
+    }
+    if (command & (1 << 17)) {
+        uint16_t regno = command & 0xFFFF;
+        bool write = command & (1 << 16);
+        uint32_t* reg;
+        if (regno >= 0x1000 && regno < 0x1020) {
+            reg = &sim->x[regno - 0x1000];
+        } else if (regno == 0x7B0) {
+            reg = &sim->dcsr;
+        } else if (regno == 0x7B1) {
+            reg = &sim->dpc;
+        } else {
+            sim->cmderr = SIM_CMDERR_EXCEPTION;
+            return;
+        }
+        if (write) {
+            if (reg != &sim->x[0]) {
+                *reg = sim->data[0];
+            }
+        } else {
+            sim->data[0] = *reg;
+        }
+    }
+    if (command & (1 << 18)) {
+        if (!sim_run_progbuf(sim)) {
+            sim->cmderr = SIM_CMDERR_EXCEPTION;
+        }
+    }
+}
+
+static void sim_write_dmcontrol(rvswd_sim_t* sim, uint32_t value) {
+    sim->dmcontrol = value & ((1 << 31) | (1 << 1) | (1 << 0));
+    if (!(value & 1)) {
+        return;
+    }
+    if (value & (1 << 28)) {  // ackhavereset
+        sim->havereset = false;
+    }
+    if (value & (1 << 1)) {  // ndmreset
+        memset(sim->x, 0, sizeof(sim->x));
+        sim->havereset = true;
+        sim->halted = false;
+        sim->locked = true;
+        sim->fast_locked = true;
+        sim->ctlr = 0;
+        sim->busy_until = 0;
+        return;
+    }
+    if (value & (1u << 31)) {  // haltreq
+        sim->halted = true;
+        sim->resumeack = false;
+    } else if ((value & (1 << 30)) && sim->halted) {  // resumereq
+        sim->halted = false;
+        sim->resumeack = true;
+    }
+}
+
+static uint32_t sim_read_register(rvswd_sim_t* sim, uint8_t reg) {
+    switch (reg) {
+        case SIM_DATA0:
+        case SIM_DATA1: {
+            if (sim_abstract_busy(sim)) {
+                sim->cmderr = sim->cmderr ? sim->cmderr : SIM_CMDERR_BUSY;
+                return sim->data[reg - SIM_DATA0];
+            }
+            uint32_t value = sim->data[reg - SIM_DATA0];
+            if (sim->abstractauto & (1 << (reg - SIM_DATA0))) {
+                sim_execute_command(sim);
+            }
+            return value;
+        }
+        case SIM_DMCONTROL:
+            return sim->dmcontrol;
+        case SIM_DMSTATUS: {
+            uint32_t value = 0x82;  // Authenticated, debug spec 0.13
+            value |= sim->halted ? (3 << 8) : (3 << 10);
+            value |= sim->resumeack ? (3 << 16) : 0;
+            value |= sim->havereset ? (3 << 18) : 0;
+            return value;
+        }
+        case SIM_ABSTRACTCS:
+            return (8 << 24) | (sim_abstract_busy(sim) ? (1 << 12) : 0) | (sim->cmderr << 8) | 2;
+        case SIM_COMMAND:
+            return sim->command;
+        case SIM_ABSTRACTAUTO:
+            return sim->abstractauto;
+        default:
+            if (reg >= SIM_PROGBUF0 && reg <= SIM_PROGBUF7) {
+                return sim->progbuf[reg - SIM_PROGBUF0];
+            }
+            return 0;
+    }
+}
+
+static void sim_write_register(rvswd_sim_t* sim, uint8_t reg, uint32_t value) {
+    switch (reg) {
+        case SIM_DATA0:
+        case SIM_DATA1:
+            if (sim_abstract_busy(sim)) {
+                sim->cmderr = sim->cmderr ? sim->cmderr : SIM_CMDERR_BUSY;
+                return;
+            }
+            sim->data[reg - SIM_DATA0] = value;
+            if (sim->abstractauto & (1 << (reg - SIM_DATA0))) {
+                sim_execute_command(sim);
+            }
+            break;
+        case SIM_DMCONTROL:
+            sim_write_dmcontrol(sim, value);
+            break;
+        case SIM_ABSTRACTCS:
+            sim->cmderr &= ~((value >> 8) & 7);
+            break;
+        case SIM_COMMAND:
+            if (sim_abstract_busy(sim)) {
+                sim->cmderr = sim->cmderr ? sim->cmderr : SIM_CMDERR_BUSY;
+                return;
+            }
+            sim->command = value;
+            sim_execute_command(sim);
+            break;
+        case SIM_ABSTRACTAUTO:
+            sim->abstractauto = value & 3;
+            break;
+        default:
+            if (reg >= SIM_PROGBUF0 && reg <= SIM_PROGBUF7) {
+                if (sim_abstract_busy(sim)) {
+                    sim->cmderr = sim->cmderr ? sim->cmderr : SIM_CMDERR_BUSY;
+                    return;
+                }
+                sim->progbuf[reg - SIM_PROGBUF0] = value;
+            }
+            break;
+    }
+}
+
+// Wire
+
+static void sim_start(void* user) {
+    rvswd_sim_t* sim = user;
+    sim->active = true;
+    sim->reading = false;
+    sim->bit = 0;
+    sim->shift = 0;
+}
+
+static void sim_stop(void* user) {
+    rvswd_sim_t* sim = user;
+    if (sim->active && !sim->reading && sim->bit == RVSWD_FRAME_WRITE_BITS) {
+        uint8_t reg = (sim->shift >> (RVSWD_FRAME_WRITE_BITS - 7)) & 0x7F;
+        uint32_t value = sim->shift >> (RVSWD_FRAME_TRAILER_BITS + 1);
+        bool parity = (sim->shift >> RVSWD_FRAME_TRAILER_BITS) & 1;
+        bool dropped = sim->drop_rate && sim_random(sim, sim->drop_rate);
+        if (((sim->shift >> (RVSWD_FRAME_WRITE_BITS - 8)) & 1) && parity == __builtin_parity(value) && !dropped) {
+            sim_write_register(sim, reg, sim->shift >> (RVSWD_FRAME_TRAILER_BITS + 1));
+        }
+    }
+    sim->active = false;
+}
+
+static bool sim_clock(void* user, bool swdio) {
+    rvswd_sim_t* sim = user;
+    if (!sim->active || sim->bit >= RVSWD_FRAME_WRITE_BITS) {
+        return swdio;  // Line reset or excess clocks
+    }
+    uint8_t bit = sim->bit++;
+    swdio = sim_wire(sim, swdio);
+
+    if (sim->reading) {
+        // The target drives the data and parity bits that follow the header
+        if (bit < RVSWD_FRAME_HEADER_BITS + 32) {
+            return sim_wire(sim, swdio && ((sim->response >> (RVSWD_FRAME_HEADER_BITS + 31 - bit)) & 1));
+        }
+        if (bit == RVSWD_FRAME_HEADER_BITS + 32) {
+            return sim_wire(sim, swdio && sim->parity);
+        }
+        return swdio;
+    }
+
+    sim->shift = (sim->shift << 1) | swdio;
+    if (bit == RVSWD_FRAME_HEADER_BITS - 1 && !((sim->shift >> 6) & 1)) {
+        sim->reading = true;
+        sim->response = sim_read_register(sim, (sim->shift >> 7) & 0x7F);
+        sim->parity = __builtin_parity(sim->response);
+        if (sim->error_rate && sim_random(sim, sim->error_rate)) {
+            sim->parity = !sim->parity;
+        }
+    }
+    return swdio;
+}
+
+static rvswd_sim_t* sim_alloc(rvswd_sim_config_t const* config, rvswd_handle_t* handle) {
+    rvswd_sim_t* sim = calloc(1, sizeof(rvswd_sim_t));
+    if (sim == NULL) {
+        return NULL;
+    }
+    sim->config = *config;
+    sim->flash = malloc(config->flash_size);
+    sim->sram = calloc(1, config->sram_size);
+    sim->page_erased = calloc(config->flash_size / SIM_PAGE_SIZE, sizeof(bool));
+    if (sim->flash == NULL || sim->sram == NULL || sim->page_erased == NULL) {
+        rvswd_sim_destroy(sim);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < config->flash_size; i += 4) {
+        memcpy(&sim->flash[i], &config->erased_value, 4);
+    }
+    memset(sim->page_erased, true, config->flash_size / SIM_PAGE_SIZE);
+
+    sim->option_bytes[0] = 0x00FF5AA5;  // Read protection disabled
+    sim->option_bytes[1] = 0x00FF00FF;
+    sim->option_bytes[2] = 0x00FF00FF;
+    sim->option_bytes[3] = 0x00FF00FF;
+    sim->locked = true;
+    sim->fast_locked = true;
+    sim->random = 1;
+
+    sim->mock.user = sim;
+    sim->mock.start = sim_start;
+    sim->mock.stop = sim_stop;
+    sim->mock.clock = sim_clock;
+    sim->mock.clock_ns = config->clock_ns;
+    sim->handle = handle;
+    return sim;
+}
+
+rvswd_sim_t* rvswd_sim_create(rvswd_sim_config_t const* config, rvswd_handle_t* handle) {
+    rvswd_sim_t* sim = sim_alloc(config, handle);
+    if (sim == NULL) {
+        return NULL;
+    }
+    handle->transport = &rvswd_transport_mock;
+    handle->transport_ctx = &sim->mock;
+    return sim;
+}
+
+void rvswd_sim_destroy(rvswd_sim_t* sim) {
+    if (sim) {
+        free(sim->flash);
+        free(sim->sram);
+        free(sim->page_erased);
+        free(sim);
+    }
+}
+
+// Gang
+
+struct rvswd_sim_gang {
+    rvswd_gang_t gang;
+    rvswd_gang_port_t port;
+    rvswd_handle_t* handle;
+    rvswd_sim_t* sims[RVSWD_GANG_MAX];
+    uint32_t lines;   // Levels driven by the host
+    uint32_t pulled;  // SWDIO lines a target drives low
+    uint32_t quiet;   // SWDIO lines without a rising clock edge since their last change
+};
+
+// The data changes while the clock is high, only two changes of SWDIO without a clock edge in between, the low one
+// of a stop and the next start, are taken as conditions
+static void sim_gang_write(void* ctx, uint32_t set, uint32_t clear) {
+    rvswd_sim_gang_t* sim_gang = ctx;
+    uint32_t before = sim_gang->lines;
+    sim_gang->lines = (before | set) & ~clear;
+    uint32_t changed = before ^ sim_gang->lines;
+    uint32_t rising = changed & sim_gang->lines;
+
+    bool clocked = false;
+    for (uint8_t i = 0; i < sim_gang->gang.count; i++) {
+        rvswd_sim_t* sim = sim_gang->sims[i];
+        uint32_t swdio = 1UL << sim_gang->gang.swdio[i];
+        uint32_t swclk = 1UL << sim_gang->gang.swclk[i];
+        if (rising & swclk) {
+            bool level = sim_clock(sim, sim_gang->lines & swdio);
+            sim_gang->pulled = level ? sim_gang->pulled & ~swdio : sim_gang->pulled | swdio;
+            sim_gang->quiet &= ~swdio;
+            clocked = true;
+        } else if (changed & swdio) {
+            if ((sim_gang->quiet & swdio) && (sim_gang->lines & swclk)) {
+                if (rising & swdio) {
+                    sim_stop(sim);
+                } else {
+                    sim_start(sim);
+                }
+                sim_gang->pulled &= ~swdio;
+            }
+            sim_gang->quiet |= swdio;
+        }
+    }
+
+    // Time passes for every target, selected or not
+    if (clocked) {
+        for (uint8_t i = 0; i < sim_gang->gang.count; i++) {
+            rvswd_mock_t* mock = &sim_gang->sims[i]->mock;
+            uint32_t period_ns = mock->clock_ns;
+            if (sim_gang->handle->clock_hz && 1000000000 / sim_gang->handle->clock_hz > period_ns) {
+                period_ns = 1000000000 / sim_gang->handle->clock_hz;
+            }
+            mock->clocks++;
+            mock->clocked_ns += period_ns;
+        }
+    }
+}
+
+static uint32_t sim_gang_read(void* ctx) {
+    rvswd_sim_gang_t* sim_gang = ctx;
+    return sim_gang->lines & ~sim_gang->pulled;
+}
+
+static void sim_gang_delay_us(void* ctx, uint32_t us) {
+    rvswd_sim_gang_t* sim_gang = ctx;
+    for (uint8_t i = 0; i < sim_gang->gang.count; i++) {
+        sim_gang->sims[i]->mock.delayed_us += us;
+    }
+}
+
+static int64_t sim_gang_time_us(void* ctx) {
+    rvswd_sim_gang_t* sim_gang = ctx;
+    return rvswd_sim_time_us(sim_gang->sims[0]);
+}
+
+rvswd_sim_gang_t* rvswd_sim_gang_create(rvswd_sim_config_t const* const* configs, uint8_t count,
+                                        rvswd_handle_t* handle) {
+    if (count == 0 || count > RVSWD_GANG_MAX) {
+        return NULL;
+    }
+    rvswd_sim_gang_t* sim_gang = calloc(1, sizeof(rvswd_sim_gang_t));
+    if (sim_gang == NULL) {
+        return NULL;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        sim_gang->sims[i] = sim_alloc(configs[i], handle);
+        if (sim_gang->sims[i] == NULL) {
+            rvswd_sim_gang_destroy(sim_gang);
+            return NULL;
+        }
+        sim_gang->gang.swdio[i] = 2 * i;
+        sim_gang->gang.swclk[i] = 2 * i + 1;
+    }
+    sim_gang->gang.count = count;
+    sim_gang->port.write = sim_gang_write;
+    sim_gang->port.read = sim_gang_read;
+    sim_gang->port.delay_us = sim_gang_delay_us;
+    sim_gang->port.time_us = sim_gang_time_us;
+    sim_gang->port.ctx = sim_gang;
+    sim_gang->gang.port = &sim_gang->port;
+    sim_gang->handle = handle;
+    sim_gang->lines = UINT32_MAX;  // Pulled up
+    sim_gang->quiet = UINT32_MAX;  // Idle, the first change of SWDIO is a start
+    handle->transport = &rvswd_transport_gang;
+    handle->transport_ctx = &sim_gang->gang;
+    return sim_gang;
+}
+
+void rvswd_sim_gang_destroy(rvswd_sim_gang_t* sim_gang) {
+    if (sim_gang) {
+        for (uint8_t i = 0; i < RVSWD_GANG_MAX; i++) {
+            rvswd_sim_destroy(sim_gang->sims[i]);
+        }
+        free(sim_gang);
+    }
+}
+
+rvswd_sim_t* rvswd_sim_gang_target(rvswd_sim_gang_t* sim_gang, uint8_t target) {
+    return target < sim_gang->gang.count ? sim_gang->sims[target] : NULL;
+}
@@ -0,0 +1,42 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "rvswd_source.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static bool rvswd_source_memory_read(void* ctx, size_t offset, void* buffer, size_t length) {
+    memcpy(buffer, (uint8_t const*)ctx + offset, length);
+    return true;
+}
+
+static bool rvswd_source_file_read(void* ctx, size_t offset, void* buffer, size_t length) {
+    FILE* file = ctx;
+    if (fseek(file, offset, SEEK_SET) != 0) {
+        return false;
+    }
+    return fread(buffer, 1, length, file) == length;
+}
+
+void rvswd_source_memory(rvswd_source_t* source, void const* data, size_t length) {
+    source->read = rvswd_source_memory_read;
+    source->ctx = (void*)data;
+    source->length = length;
+}
+
+void rvswd_source_file(rvswd_source_t* source, FILE* file, size_t length) {
+    source->read = rvswd_source_file_read;
+    source->ctx = file;
+    source->length = length;
+}
+
+bool rvswd_source_read(rvswd_source_t const* source, size_t offset, void* buffer, size_t length) {
+    if (offset > source->length || length > source->length - offset) {
+        return false;
+    }
+    return source->read(source->ctx, offset, buffer, length);
+}
@@ -0,0 +1,18 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "rvswd_source_partition.h"
+#include "esp_partition.h"
+
+static bool rvswd_source_partition_read(void* ctx, size_t offset, void* buffer, size_t length) {
+    return esp_partition_read(ctx, offset, buffer, length) == ESP_OK;
+}
+
+void rvswd_source_partition(rvswd_source_t* source, esp_partition_t const* partition, size_t length) {
+    source->read = rvswd_source_partition_read;
+    source->ctx = (void*)partition;
+    source->length = length;
+}
@@ -0,0 +1,180 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "rvswd_spi.h"
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+#include "esp_rom_gpio.h"
+#include "hal/gpio_ll.h"
+#include "rvswd.h"
+#include "rvswd_frame.h"
+#include "soc/gpio_sig_map.h"
+#include "soc/gpio_struct.h"
+#include "soc/spi_periph.h"
+
+// The frame body is sent in SPI mode 0 (clock idles low, data sampled on the rising edge) over a 3-wire
+// half-duplex bus with SWDIO as the shared data line. The SPI peripheral samples on the rising edge while
+// the target changes SWDIO on that same edge, so every read bit is taken one clock later than it is driven.
+// The receive phase is therefore one bit longer than the data, the extra clock doubles as the first
+// trailer bit which the host sends released (high) anyway.
+
+#define SPI_RVSWD_READ_BITS (RVSWD_FRAME_DATA_BITS + 1)
+
+static void spi_rvswd_attach(rvswd_handle_t* handle) {
+    rvswd_spi_t* spi = handle->transport_ctx;
+    esp_rom_gpio_connect_out_signal(handle->swdio, spi_periph_signal[spi->host].spid_out, false, false);
+    esp_rom_gpio_connect_out_signal(handle->swclk, spi_periph_signal[spi->host].spiclk_out, false, false);
+}
+
+static void spi_rvswd_detach(rvswd_handle_t* handle) {
+    // Both lines are low at the end of a transaction, keep them there while switching over
+    gpio_ll_set_level(&GPIO, handle->swdio, false);
+    gpio_ll_set_level(&GPIO, handle->swclk, false);
+    esp_rom_gpio_connect_out_signal(handle->swdio, SIG_GPIO_OUT_IDX, false, false);
+    esp_rom_gpio_connect_out_signal(handle->swclk, SIG_GPIO_OUT_IDX, false, false);
+}
+
+static esp_err_t spi_rvswd_add_device(rvswd_spi_t* spi, int clock_speed_hz) {
+    spi_device_interface_config_t dev_cfg = {
+        .mode = 0,
+        .clock_speed_hz = clock_speed_hz,
+        .spics_io_num = -1,
+        .queue_size = 1,
+        .flags = SPI_DEVICE_3WIRE | SPI_DEVICE_HALFDUPLEX,
+    };
+    return spi_bus_add_device(spi->host, &dev_cfg, &spi->device);
+}
+
+static rvswd_result_t spi_rvswd_init(rvswd_handle_t* handle) {
+    rvswd_spi_t* spi = handle->transport_ctx;
+    if (spi == NULL) {
+        return RVSWD_INVALID_ARGS;
+    }
+
+    if (spi->device == NULL) {
+        spi_bus_config_t bus_cfg = {
+            .mosi_io_num = handle->swdio,
+            .miso_io_num = -1,
+            .sclk_io_num = handle->swclk,
+            .quadwp_io_num = -1,
+            .quadhd_io_num = -1,
+            .max_transfer_sz = RVSWD_FRAME_WRITE_BYTES,
+            .flags = SPICOMMON_BUSFLAG_MASTER | SPICOMMON_BUSFLAG_GPIO_PINS,
+        };
+        if (spi_bus_initialize(spi->host, &bus_cfg, SPI_DMA_DISABLED) != ESP_OK) {
+            return RVSWD_FAIL;
+        }
+
+        if (spi_rvswd_add_device(spi, spi->clock_speed_hz) != ESP_OK) {
+            spi_bus_free(spi->host);
+            return RVSWD_FAIL;
+        }
+    }
+
+    // Configure the pads for bit-banging the start and stop conditions, SWDIO stays open-drain in both modes
+    rvswd_result_t res = rvswd_transport_gpio.init(handle);
+    if (res != RVSWD_OK) {
+        return res;
+    }
+    esp_rom_gpio_connect_in_signal(handle->swdio, spi_periph_signal[spi->host].spid_in, false);
+    spi_rvswd_detach(handle);
+    return RVSWD_OK;
+}
+
+static rvswd_result_t spi_rvswd_write_frame(rvswd_handle_t* handle, uint8_t reg, uint32_t value) {
+    rvswd_spi_t* spi = handle->transport_ctx;
+    uint8_t tx[RVSWD_FRAME_WRITE_BYTES];
+    spi_transaction_t transaction = {
+        .length = rvswd_frame_encode_write(reg, value, tx),
+        .tx_buffer = tx,
+    };
+
+    rvswd_transport_gpio.start(handle);
+    spi_rvswd_attach(handle);
+    esp_err_t res = spi_device_polling_transmit(spi->device, &transaction);
+    spi_rvswd_detach(handle);
+    rvswd_transport_gpio.stop(handle);
+
+    return (res == ESP_OK) ? RVSWD_OK : RVSWD_FAIL;
+}
+
+static rvswd_result_t spi_rvswd_read_frame(rvswd_handle_t* handle, uint8_t reg, uint32_t* value) {
+    rvswd_spi_t* spi = handle->transport_ctx;
+    uint8_t tx[RVSWD_FRAME_HEADER_BYTES];
+    uint8_t rx[(SPI_RVSWD_READ_BITS + 7) / 8] = {0};
+    spi_transaction_t transaction = {
+        .length = rvswd_frame_encode_read(reg, tx),
+        .rxlength = SPI_RVSWD_READ_BITS,
+        .tx_buffer = tx,
+        .rx_buffer = rx,
+    };
+
+    rvswd_transport_gpio.start(handle);
+    spi_rvswd_attach(handle);
+    esp_err_t res = spi_device_polling_transmit(spi->device, &transaction);
+    spi_rvswd_detach(handle);
+
+    // Remainder of the trailer, the first bit was clocked by the receive phase
+    rvswd_transport_gpio.write_bits(handle, RVSWD_FRAME_DATA_TRAILER, RVSWD_FRAME_TRAILER_BITS - 1);
+    rvswd_transport_gpio.stop(handle);
+
+    if (res != ESP_OK) {
+        return RVSWD_FAIL;
+    }
+    return rvswd_frame_decode_read(rx, 1, value);
+}
+
+// The device clock is fixed when it is added, it is added again at the new frequency
+static rvswd_result_t spi_rvswd_set_clock(rvswd_handle_t* handle) {
+    rvswd_spi_t* spi = handle->transport_ctx;
+    int clock_speed_hz = spi->clock_speed_hz;
+    if (handle->clock_hz && handle->clock_hz < (uint32_t)clock_speed_hz) {
+        clock_speed_hz = handle->clock_hz;
+    }
+
+    if (spi_bus_remove_device(spi->device) != ESP_OK) {
+        return RVSWD_FAIL;
+    }
+    spi->device = NULL;
+    if (spi_rvswd_add_device(spi, clock_speed_hz) != ESP_OK) {
+        return RVSWD_FAIL;
+    }
+    return RVSWD_OK;
+}
+
+static void spi_rvswd_start(rvswd_handle_t* handle) {
+    rvswd_transport_gpio.start(handle);
+}
+
+static void spi_rvswd_stop(rvswd_handle_t* handle) {
+    rvswd_transport_gpio.stop(handle);
+}
+
+static void spi_rvswd_reset(rvswd_handle_t* handle) {
+    rvswd_transport_gpio.reset(handle);
+}
+
+static void spi_rvswd_write_bits(rvswd_handle_t* handle, uint32_t bits, uint8_t count) {
+    rvswd_transport_gpio.write_bits(handle, bits, count);
+}
+
+static uint32_t spi_rvswd_read_bits(rvswd_handle_t* handle, uint8_t count) {
+    return rvswd_transport_gpio.read_bits(handle, count);
+}
+
+rvswd_transport_t const rvswd_transport_spi = {
+    .init = spi_rvswd_init,
+    .start = spi_rvswd_start,
+    .stop = spi_rvswd_stop,
+    .reset = spi_rvswd_reset,
+    .write_bits = spi_rvswd_write_bits,
+    .read_bits = spi_rvswd_read_bits,
+    .write_frame = spi_rvswd_write_frame,
+    .read_frame = spi_rvswd_read_frame,
+    .set_clock = spi_rvswd_set_clock,
+    .blocking = true,
+};
@@ -0,0 +1,54 @@
+/**
+ * Copyright (c) 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "rvswd_stats.h"
+#include <stdint.h>
+#include <string.h>
+#include "rvswd.h"
+
+#if CONFIG_RVSWD_STATS
+
+void rvswd_stats_record(rvswd_handle_t* handle, rvswd_stats_phase_t phase, uint32_t duration_us) {
+    rvswd_stats_timing_t* timing = &handle->stats.phases[phase];
+    if (timing->count == 0 || duration_us < timing->min_us) {
+        timing->min_us = duration_us;
+    }
+    if (duration_us > timing->max_us) {
+        timing->max_us = duration_us;
+    }
+    timing->count++;
+    timing->total_us += duration_us;
+
+    uint8_t bucket = 0;
+    while (bucket < RVSWD_STATS_BUCKETS - 1 && duration_us >= (16UL << (2 * bucket))) {
+        bucket++;
+    }
+    timing->histogram[bucket]++;
+}
+
+#endif
+
+bool rvswd_stats_get(rvswd_handle_t* handle, rvswd_stats_t* stats) {
+#if CONFIG_RVSWD_STATS
+    *stats = handle->stats;
+    stats->errors = handle->errors;
+    stats->lock = handle->lock_stats;
+    return true;
+#else
+    memset(stats, 0, sizeof(*stats));
+    stats->errors = handle->errors;
+    stats->lock = handle->lock_stats;
+    return false;
+#endif
+}
+
+void rvswd_stats_reset(rvswd_handle_t* handle) {
+#if CONFIG_RVSWD_STATS
+    memset(&handle->stats, 0, sizeof(handle->stats));
+#else
+    (void)handle;
+#endif
+}
@@ -0,0 +1,138 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "rvswd.h"
+#include "rvswd_frame.h"
+#include "rvswd_mock.h"
+#include "unity.h"
+
+static uint32_t const values[] = {0x00000000, 0xFFFFFFFF, 0x00000001, 0x80000000, 0xAAAAAAAA,
+                                  0x55555555, 0x12345678, 0xDEADBEEF, 0x0F1E2D3C, 0xC3B4A596};
+
+#define VALUE_COUNT (sizeof(values) / sizeof(values[0]))
+
+// Levels driven by the host on every clock edge between the start and the stop condition of the last frame
+typedef struct recorder {
+    uint8_t bits[64];
+    size_t count;
+} recorder_t;
+
+static void recorder_start(void* user) {
+    recorder_t* recorder = user;
+    recorder->count = 0;
+}
+
+static bool recorder_clock(void* user, bool swdio) {
+    recorder_t* recorder = user;
+    if (recorder->count < sizeof(recorder->bits)) {
+        recorder->bits[recorder->count++] = swdio;
+    }
+    return swdio;
+}
+
+static bool bit_at(uint8_t const* buffer, size_t index) {
+    return (buffer[index / 8] >> (7 - index % 8)) & 1;
+}
+
+static void set_bit(uint8_t* buffer, size_t index, bool value) {
+    if (value) {
+        buffer[index / 8] |= 0x80 >> (index % 8);
+    }
+}
+
+TEST_CASE("frame header holds address, operation, parity and trailer", "[frame]") {
+    for (uint8_t reg = 0; reg < 0x80; reg++) {
+        for (int write = 0; write < 2; write++) {
+            uint16_t header = rvswd_frame_header(reg, write);
+            uint8_t address_op = header >> 6;
+            TEST_ASSERT_EQUAL_UINT16(0, header >> RVSWD_FRAME_HEADER_BITS);
+            TEST_ASSERT_EQUAL_UINT8(reg, address_op >> 1);
+            TEST_ASSERT_EQUAL(write, address_op & 1);
+            TEST_ASSERT_EQUAL(__builtin_parity(address_op), (header >> 5) & 1);
+            TEST_ASSERT_EQUAL_HEX8(RVSWD_FRAME_HEADER_TRAILER, header & 0x1F);
+        }
+    }
+}
+
+TEST_CASE("frame trailer holds the data parity", "[frame]") {
+    for (size_t i = 0; i < VALUE_COUNT; i++) {
+        uint8_t trailer = rvswd_frame_trailer(values[i]);
+        TEST_ASSERT_EQUAL(__builtin_parity(values[i]), trailer >> 5);
+        TEST_ASSERT_EQUAL_HEX8(RVSWD_FRAME_DATA_TRAILER, trailer & 0x1F);
+        TEST_ASSERT_EQUAL(RVSWD_OK, rvswd_frame_check(values[i], trailer >> 5));
+        TEST_ASSERT_EQUAL(RVSWD_PARITY_ERROR, rvswd_frame_check(values[i], !(trailer >> 5)));
+        TEST_ASSERT_EQUAL(RVSWD_PARITY_ERROR, rvswd_frame_check(values[i] ^ 0x00010000, trailer >> 5));
+    }
+}
+
+TEST_CASE("packed write frame matches the bit-banged frame", "[frame]") {
+    recorder_t recorder = {0};
+    rvswd_mock_t mock = {.user = &recorder, .start = recorder_start, .clock = recorder_clock};
+    rvswd_handle_t handle = {.transport = &rvswd_transport_mock, .transport_ctx = &mock};
+    TEST_ASSERT_EQUAL(RVSWD_OK, rvswd_init(&handle));
+
+    for (size_t i = 0; i < VALUE_COUNT; i++) {
+        uint8_t reg = (i * 0x13) & 0x7F;
+        uint8_t buffer[RVSWD_FRAME_WRITE_BYTES];
+        memset(buffer, 0xA5, sizeof(buffer));
+        TEST_ASSERT_EQUAL(RVSWD_FRAME_WRITE_BITS, rvswd_frame_encode_write(reg, values[i], buffer));
+
+        TEST_ASSERT_EQUAL(RVSWD_OK, rvswd_write(&handle, reg, values[i]));
+        TEST_ASSERT_EQUAL(RVSWD_FRAME_WRITE_BITS, recorder.count);
+        for (size_t bit = 0; bit < RVSWD_FRAME_WRITE_BYTES * 8; bit++) {
+            bool expected = bit < RVSWD_FRAME_WRITE_BITS ? recorder.bits[bit] : false;  // Padding is zero
+            TEST_ASSERT_EQUAL_MESSAGE(expected, bit_at(buffer, bit), "bit of the packed frame");
+        }
+    }
+}
+
+TEST_CASE("packed read header matches the bit-banged header", "[frame]") {
+    recorder_t recorder = {0};
+    rvswd_mock_t mock = {.user = &recorder, .start = recorder_start, .clock = recorder_clock};
+    rvswd_handle_t handle = {.transport = &rvswd_transport_mock, .transport_ctx = &mock};
+    TEST_ASSERT_EQUAL(RVSWD_OK, rvswd_init(&handle));
+
+    for (uint8_t reg = 0; reg < 0x80; reg += 7) {
+        uint8_t buffer[RVSWD_FRAME_HEADER_BYTES];
+        memset(buffer, 0xA5, sizeof(buffer));
+        TEST_ASSERT_EQUAL(RVSWD_FRAME_HEADER_BITS, rvswd_frame_encode_read(reg, buffer));
+
+        // Nothing drives the line back, so the data reads as ones and fails the parity check, only the header matters
+        uint32_t value;
+        rvswd_read(&handle, reg, &value);
+        TEST_ASSERT_GREATER_OR_EQUAL(RVSWD_FRAME_HEADER_BITS, recorder.count);
+        for (size_t bit = 0; bit < RVSWD_FRAME_HEADER_BYTES * 8; bit++) {
+            bool expected = bit < RVSWD_FRAME_HEADER_BITS ? recorder.bits[bit] : false;
+            TEST_ASSERT_EQUAL_MESSAGE(expected, bit_at(buffer, bit), "bit of the packed header");
+        }
+    }
+}
+
+TEST_CASE("read data decodes at every bit offset", "[frame]") {
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t i = 0; i < VALUE_COUNT; i++) {
+            for (int flip = 0; flip < 2; flip++) {
+                // Data, parity and the trailer clocked in after the host released the line
+                uint8_t buffer[8] = {0};
+                for (size_t bit = 0; bit < 32; bit++) {
+                    set_bit(buffer, offset + bit, (values[i] >> (31 - bit)) & 1);
+                }
+                set_bit(buffer, offset + 32, __builtin_parity(values[i]) ^ flip);
+                for (size_t bit = 0; bit < RVSWD_FRAME_TRAILER_BITS; bit++) {
+                    set_bit(buffer, offset + 33 + bit, (RVSWD_FRAME_DATA_TRAILER >> (4 - bit)) & 1);
+                }
+
+                uint32_t value = 0;
+                rvswd_result_t res = rvswd_frame_decode_read(buffer, offset, &value);
+                TEST_ASSERT_EQUAL_HEX32(values[i], value);
+                TEST_ASSERT_EQUAL(flip ? RVSWD_PARITY_ERROR : RVSWD_OK, res);
+            }
+        }
+    }
+}
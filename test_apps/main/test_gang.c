@@ -0,0 +1,97 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "rvswd.h"
+#include "rvswd_ch32v20x.h"
+#include "rvswd_gang.h"
+#include "rvswd_sim.h"
+#include "unity.h"
+
+#define IMAGE_SIZE (4 * 1024 + 100)  // Ends inside a page
+
+static uint8_t image[IMAGE_SIZE];
+
+static rvswd_sim_config_t const* const v203_gang[] = {&rvswd_sim_ch32v203, &rvswd_sim_ch32v203, &rvswd_sim_ch32v203};
+
+static void image_fill(uint32_t seed) {
+    for (size_t i = 0; i < sizeof(image); i++) {
+        image[i] = (i * 11 + (i >> 8) + seed) & 0xFF;
+    }
+}
+
+static bool flash_erased(rvswd_sim_t* sim, rvswd_sim_config_t const* config) {
+    uint8_t const* flash = rvswd_sim_flash(sim);
+    for (size_t i = 0; i < sizeof(image); i += 4) {
+        if (memcmp(&flash[i], &config->erased_value, 4) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST_CASE("gang programs every target", "[gang]") {
+    rvswd_handle_t handle = {0};
+    rvswd_sim_gang_t* sim_gang = rvswd_sim_gang_create(v203_gang, 3, &handle);
+    TEST_ASSERT_NOT_NULL(sim_gang);
+    rvswd_gang_t* gang = handle.transport_ctx;
+    image_fill(1);
+
+    TEST_ASSERT_TRUE(ch32v20x_program_gang(&handle, image, sizeof(image), CH32V20X_PROGRAM_DEFAULT, NULL, NULL));
+    TEST_ASSERT_EQUAL_HEX32(0b111, gang->selected);
+    for (uint8_t i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL(RVSWD_OK, gang->result[i]);
+        TEST_ASSERT_EQUAL_MEMORY(image, rvswd_sim_flash(rvswd_sim_gang_target(sim_gang, i)), sizeof(image));
+    }
+    rvswd_sim_gang_destroy(sim_gang);
+}
+
+TEST_CASE("gang programs only the selected targets", "[gang]") {
+    rvswd_handle_t handle = {0};
+    rvswd_sim_gang_t* sim_gang = rvswd_sim_gang_create(v203_gang, 3, &handle);
+    TEST_ASSERT_NOT_NULL(sim_gang);
+    rvswd_gang_t* gang = handle.transport_ctx;
+    image_fill(2);
+
+    // Attaching initializes the transport again, which must keep the selection
+    TEST_ASSERT_EQUAL_HEX32(0b101, rvswd_gang_select(&handle, 0b101));
+    TEST_ASSERT_TRUE(ch32v20x_program_gang(&handle, image, sizeof(image), CH32V20X_PROGRAM_DEFAULT, NULL, NULL));
+    TEST_ASSERT_EQUAL_HEX32(0b101, gang->selected);
+    TEST_ASSERT_EQUAL_MEMORY(image, rvswd_sim_flash(rvswd_sim_gang_target(sim_gang, 0)), sizeof(image));
+    TEST_ASSERT_TRUE(flash_erased(rvswd_sim_gang_target(sim_gang, 1), &rvswd_sim_ch32v203));
+    TEST_ASSERT_EQUAL_MEMORY(image, rvswd_sim_flash(rvswd_sim_gang_target(sim_gang, 2)), sizeof(image));
+
+    // A failed target stays out until the gang is cleared
+    rvswd_gang_fail(&handle, 0, RVSWD_FAIL);
+    image_fill(3);
+    TEST_ASSERT_TRUE(ch32v20x_program_gang(&handle, image, sizeof(image), CH32V20X_PROGRAM_DEFAULT, NULL, NULL));
+    TEST_ASSERT_EQUAL_HEX32(0b100, gang->selected);
+    TEST_ASSERT_EQUAL(RVSWD_FAIL, gang->result[0]);
+    TEST_ASSERT_EQUAL_MEMORY(image, rvswd_sim_flash(rvswd_sim_gang_target(sim_gang, 2)), sizeof(image));
+
+    rvswd_gang_clear(&handle);
+    TEST_ASSERT_TRUE(ch32v20x_program_gang(&handle, image, sizeof(image), CH32V20X_PROGRAM_DEFAULT, NULL, NULL));
+    for (uint8_t i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL_MEMORY(image, rvswd_sim_flash(rvswd_sim_gang_target(sim_gang, i)), sizeof(image));
+    }
+    rvswd_sim_gang_destroy(sim_gang);
+}
+
+TEST_CASE("gang of different targets fails without a family", "[gang]") {
+    rvswd_sim_config_t const* const configs[] = {&rvswd_sim_ch32v203, &rvswd_sim_ch32x035};
+    rvswd_handle_t handle = {0};
+    rvswd_sim_gang_t* sim_gang = rvswd_sim_gang_create(configs, 2, &handle);
+    TEST_ASSERT_NOT_NULL(sim_gang);
+    image_fill(1);
+
+    // The chip IDs are read combined and match no family
+    TEST_ASSERT_FALSE(ch32v20x_program_gang(&handle, image, sizeof(image), CH32V20X_PROGRAM_DEFAULT, NULL, NULL));
+    TEST_ASSERT_TRUE(flash_erased(rvswd_sim_gang_target(sim_gang, 0), configs[0]));
+    TEST_ASSERT_TRUE(flash_erased(rvswd_sim_gang_target(sim_gang, 1), configs[1]));
+    rvswd_sim_gang_destroy(sim_gang);
+}
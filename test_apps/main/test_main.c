@@ -0,0 +1,16 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include <stdlib.h>
+#include "unity.h"
+#include "unity_test_runner.h"
+
+// Runs every TEST_CASE of the app and exits with a non-zero status when any of them failed
+void app_main(void) {
+    UNITY_BEGIN();
+    unity_run_all_tests();
+    exit(UNITY_END() ? EXIT_FAILURE : EXIT_SUCCESS);
+}
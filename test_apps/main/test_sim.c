@@ -0,0 +1,232 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Nicolai Electronics
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "rvswd.h"
+#include "rvswd_ch32v20x.h"
+#include "rvswd_ch32x035.h"
+#include "rvswd_sim.h"
+#include "unity.h"
+
+#define IMAGE_SIZE  (16 * 1024 + 100)  // Ends inside a page
+#define FLASH_BASE  0x08000000
+#define SRAM_BASE   0x20000000
+#define PAGE_SIZE   256
+#define PAGE_WORDS  (PAGE_SIZE / 4)
+#define IMAGE_PAGES ((IMAGE_SIZE + PAGE_SIZE - 1) / PAGE_SIZE)
+
+static uint8_t image[IMAGE_SIZE];
+
+static void image_fill(uint32_t seed) {
+    for (size_t i = 0; i < sizeof(image); i++) {
+        image[i] = (i * 7 + (i >> 8) + seed) & 0xFF;
+    }
+}
+
+static void program_and_check(rvswd_handle_t* handle, rvswd_sim_t* sim, uint32_t flags,
+                              ch32v20x_program_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    TEST_ASSERT_TRUE(ch32v20x_program_ex(handle, image, sizeof(image), flags, NULL, stats));
+    TEST_ASSERT_EQUAL_MEMORY(image, rvswd_sim_flash(sim), sizeof(image));
+    TEST_ASSERT_EQUAL_UINT32(IMAGE_PAGES, stats->pages_total);
+}
+
+TEST_CASE("program and verify a CH32V203", "[sim]") {
+    rvswd_handle_t handle = {0};
+    rvswd_sim_t* sim = rvswd_sim_create(&rvswd_sim_ch32v203, &handle);
+    TEST_ASSERT_NOT_NULL(sim);
+    image_fill(1);
+
+    uint32_t const modes[] = {
+        CH32V20X_PROGRAM_DEFAULT,
+        CH32V20X_PROGRAM_LOADER | CH32V20X_PROGRAM_VERIFY_READBACK,
+        CH32V20X_PROGRAM_VERIFY_CRC,  // Flash controller driven from the host
+    };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        image_fill(i + 1);  // A new image every time, so every page is written
+        ch32v20x_program_stats_t stats;
+        program_and_check(&handle, sim, modes[i], &stats);
+        TEST_ASSERT_EQUAL_UINT32(IMAGE_PAGES, stats.pages_written);
+    }
+    rvswd_sim_destroy(sim);
+}
+
+TEST_CASE("differential reflash writes only the changed page", "[sim]") {
+    rvswd_handle_t handle = {0};
+    rvswd_sim_t* sim = rvswd_sim_create(&rvswd_sim_ch32v203, &handle);
+    TEST_ASSERT_NOT_NULL(sim);
+    image_fill(1);
+
+    ch32v20x_program_stats_t stats;
+    program_and_check(&handle, sim, CH32V20X_PROGRAM_DEFAULT, &stats);
+    TEST_ASSERT_EQUAL_UINT32(IMAGE_PAGES, stats.pages_written);
+
+    program_and_check(&handle, sim, CH32V20X_PROGRAM_DEFAULT, &stats);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.pages_written);
+    TEST_ASSERT_EQUAL_UINT32(IMAGE_PAGES, stats.pages_skipped);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.erase_operations);
+
+    image[10 * PAGE_SIZE + 17] ^= 0x40;
+    program_and_check(&handle, sim, CH32V20X_PROGRAM_DEFAULT, &stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.pages_written);
+    TEST_ASSERT_EQUAL_UINT32(IMAGE_PAGES - 1, stats.pages_skipped);
+    rvswd_sim_destroy(sim);
+}
+
+TEST_CASE("fingerprint in the last page is written, read back and checked", "[sim]") {
+    rvswd_handle_t handle = {0};
+    rvswd_sim_t* sim = rvswd_sim_create(&rvswd_sim_ch32v203, &handle);
+    TEST_ASSERT_NOT_NULL(sim);
+    image_fill(1);
+
+    // Read back verification of the fingerprint reads the last page of flash
+    uint32_t flags = CH32V20X_PROGRAM_DEFAULT | CH32V20X_PROGRAM_FINGERPRINT | CH32V20X_PROGRAM_VERIFY_READBACK;
+    ch32v20x_program_stats_t stats;
+    program_and_check(&handle, sim, flags, &stats);
+    TEST_ASSERT_TRUE(ch32v20x_is_firmware_current(&handle, image, sizeof(image)));
+
+    image[100] ^= 0x01;
+    TEST_ASSERT_FALSE(ch32v20x_is_firmware_current(&handle, image, sizeof(image)));
+    program_and_check(&handle, sim, CH32V20X_PROGRAM_DEFAULT | CH32V20X_PROGRAM_FINGERPRINT, &stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.pages_written);
+    TEST_ASSERT_TRUE(ch32v20x_is_firmware_current(&handle, image, sizeof(image)));
+    rvswd_sim_destroy(sim);
+}
+
+TEST_CASE("block reads end at the end of flash and SRAM", "[sim]") {
+    rvswd_handle_t handle = {0};
+    rvswd_sim_t* sim = rvswd_sim_create(&rvswd_sim_ch32v203, &handle);
+    TEST_ASSERT_NOT_NULL(sim);
+    uint8_t* flash = rvswd_sim_flash(sim);
+    for (size_t i = 0; i < rvswd_sim_ch32v203.flash_size; i++) {
+        flash[i] = (i * 13 + (i >> 8)) & 0xFF;
+    }
+    TEST_ASSERT_TRUE(ch32v20x_attach(&handle, false));
+
+    size_t const counts[] = {1, 2, 3, PAGE_WORDS, 2 * PAGE_WORDS + 1};
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        uint32_t data[2 * PAGE_WORDS + 1];
+        size_t offset = rvswd_sim_ch32v203.flash_size - counts[i] * 4;
+        TEST_ASSERT_TRUE(ch32v20x_read_memory_block(&handle, FLASH_BASE + offset, data, counts[i]));
+        TEST_ASSERT_EQUAL_MEMORY(&flash[offset], data, counts[i] * 4);
+
+        offset = rvswd_sim_ch32v203.sram_size - counts[i] * 4;
+        TEST_ASSERT_TRUE(ch32v20x_read_memory_block(&handle, SRAM_BASE + offset, data, counts[i]));
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, handle.errors.cmderr);
+    TEST_ASSERT_EQUAL(RVSWD_OK, ch32v20x_resume_microprocessor(&handle));
+    rvswd_sim_destroy(sim);
+}
+
+TEST_CASE("flash functions detect the family of a target halted without attaching", "[sim]") {
+    rvswd_handle_t handle = {0};
+    rvswd_sim_t* sim = rvswd_sim_create(&rvswd_sim_ch32v203, &handle);
+    TEST_ASSERT_NOT_NULL(sim);
+    image_fill(1);
+
+    TEST_ASSERT_EQUAL(RVSWD_OK, rvswd_init(&handle));
+    TEST_ASSERT_EQUAL(RVSWD_OK, rvswd_reset(&handle));
+    TEST_ASSERT_EQUAL(RVSWD_OK, ch32v20x_halt_microprocessor(&handle));
+    TEST_ASSERT_TRUE(ch32v20x_unlock_flash(&handle));
+    TEST_ASSERT_TRUE(ch32v20x_erase_flash_block(&handle, FLASH_BASE));
+    TEST_ASSERT_TRUE(ch32v20x_write_flash_block(&handle, FLASH_BASE, image));
+    TEST_ASSERT_EQUAL_MEMORY(image, rvswd_sim_flash(sim), PAGE_SIZE);
+    TEST_ASSERT_EQUAL_PTR(&ch32_family_ch32v20x, handle.target);
+    rvswd_sim_destroy(sim);
+}
+
+TEST_CASE("parity errors are retried", "[sim]") {
+    rvswd_handle_t handle = {0};
+    rvswd_sim_t* sim = rvswd_sim_create(&rvswd_sim_ch32v203, &handle);
+    TEST_ASSERT_NOT_NULL(sim);
+    image_fill(1);
+
+    rvswd_sim_set_error_rate(sim, 50);
+    ch32v20x_program_stats_t stats;
+    program_and_check(&handle, sim, CH32V20X_PROGRAM_DEFAULT, &stats);
+    TEST_ASSERT_GREATER_THAN(0, handle.errors.parity);
+    TEST_ASSERT_GREATER_THAN(0, handle.errors.retries);
+    rvswd_sim_destroy(sim);
+}
+
+TEST_CASE("lost writes are caught and the pages programmed again", "[sim]") {
+    rvswd_handle_t handle = {0};
+    rvswd_sim_t* sim = rvswd_sim_create(&rvswd_sim_ch32v203, &handle);
+    TEST_ASSERT_NOT_NULL(sim);
+    image_fill(1);
+
+    rvswd_sim_set_drop_rate(sim, 1000);
+    rvswd_sim_set_error_rate(sim, 100);
+    ch32v20x_program_stats_t stats;
+    TEST_ASSERT_TRUE(ch32v20x_program_ex(&handle, image, sizeof(image), CH32V20X_PROGRAM_DEFAULT, NULL, &stats));
+    rvswd_sim_set_drop_rate(sim, 0);
+    rvswd_sim_set_error_rate(sim, 0);
+    TEST_ASSERT_EQUAL_MEMORY(image, rvswd_sim_flash(sim), sizeof(image));
+    TEST_ASSERT_GREATER_THAN(0, stats.pages_retried + handle.errors.repeats);
+    rvswd_sim_destroy(sim);
+}
+
+TEST_CASE("program and reflash a CH32X035", "[sim]") {
+    rvswd_handle_t handle = {0};
+    rvswd_sim_t* sim = rvswd_sim_create(&rvswd_sim_ch32x035, &handle);
+    TEST_ASSERT_NOT_NULL(sim);
+    image_fill(1);
+
+    ch32v20x_program_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    TEST_ASSERT_TRUE(ch32x035_program_ex(&handle, image, sizeof(image),
+                                         CH32V20X_PROGRAM_DEFAULT | CH32V20X_PROGRAM_VERIFY_READBACK, NULL, &stats));
+    TEST_ASSERT_EQUAL_MEMORY(image, rvswd_sim_flash(sim), sizeof(image));
+    TEST_ASSERT_EQUAL_UINT32(IMAGE_PAGES, stats.pages_written);
+
+    image[3 * PAGE_SIZE] ^= 0x80;
+    TEST_ASSERT_TRUE(ch32x035_program_ex(&handle, image, sizeof(image), CH32V20X_PROGRAM_DEFAULT, NULL, &stats));
+    TEST_ASSERT_EQUAL_MEMORY(image, rvswd_sim_flash(sim), sizeof(image));
+    TEST_ASSERT_EQUAL_UINT32(1, stats.pages_written);
+    rvswd_sim_destroy(sim);
+}
+
+TEST_CASE("CH32X035 pages and blocks are erased through the family", "[sim]") {
+    rvswd_handle_t handle = {0};
+    rvswd_sim_t* sim = rvswd_sim_create(&rvswd_sim_ch32x035, &handle);
+    TEST_ASSERT_NOT_NULL(sim);
+    uint8_t* flash = rvswd_sim_flash(sim);
+    memset(flash, 0x5A, sizeof(image));
+    uint8_t erased[PAGE_SIZE];
+    memset(erased, 0xFF, sizeof(erased));
+
+    TEST_ASSERT_TRUE(ch32v20x_attach(&handle, false));
+    TEST_ASSERT_TRUE(ch32v20x_unlock_flash(&handle));
+    TEST_ASSERT_FALSE(ch32x035_erase_flash_page(&handle, FLASH_BASE + PAGE_SIZE / 2));
+    TEST_ASSERT_TRUE(ch32x035_erase_flash_page(&handle, FLASH_BASE + PAGE_SIZE));
+    TEST_ASSERT_EQUAL_MEMORY(erased, &flash[PAGE_SIZE], PAGE_SIZE);
+    TEST_ASSERT_EQUAL_UINT8(0x5A, flash[0]);
+    TEST_ASSERT_EQUAL_UINT8(0x5A, flash[2 * PAGE_SIZE]);
+
+    TEST_ASSERT_FALSE(ch32x035_erase_flash_block(&handle, FLASH_BASE + PAGE_SIZE));
+    TEST_ASSERT_TRUE(ch32x035_erase_flash_block(&handle, FLASH_BASE));
+    for (size_t i = 0; i < sizeof(image); i += PAGE_SIZE) {
+        TEST_ASSERT_EQUAL_MEMORY(erased, &flash[i], PAGE_SIZE);
+    }
+    TEST_ASSERT_EQUAL(RVSWD_OK, ch32v20x_resume_microprocessor(&handle));
+    rvswd_sim_destroy(sim);
+}
+
+TEST_CASE("CH32X035 erases fail on other targets", "[sim]") {
+    rvswd_handle_t handle = {0};
+    rvswd_sim_t* sim = rvswd_sim_create(&rvswd_sim_ch32v203, &handle);
+    TEST_ASSERT_NOT_NULL(sim);
+
+    // A 32K erase on a CH32V20X would be a sector erase of 4K
+    TEST_ASSERT_TRUE(ch32v20x_attach(&handle, false));
+    TEST_ASSERT_TRUE(ch32v20x_unlock_flash(&handle));
+    TEST_ASSERT_FALSE(ch32x035_erase_flash_page(&handle, FLASH_BASE));
+    TEST_ASSERT_FALSE(ch32x035_erase_flash_block(&handle, FLASH_BASE));
+    TEST_ASSERT_EQUAL(RVSWD_OK, ch32v20x_resume_microprocessor(&handle));
+    rvswd_sim_destroy(sim);
+}
@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2025 Nicolai Electronics
+#
+# SPDX-License-Identifier: MIT
+
+"""Compress a firmware image into the LZSS container read by rvswd_source_lzss (include/rvswd_lzss.h)."""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"RVZ1"
+WINDOW = 4096  # Distances are 12 bits, 0 marks a run of erased bytes
+MIN_MATCH = 3
+MAX_MATCH = MIN_MATCH + 15
+MIN_RUN = 16  # Shorter runs of 0xFF are cheaper as matches
+MAX_RUN = 0xFFFF
+MAX_CHAIN = 256  # Candidates tried per position
+
+
+def compress(data):
+    tokens = []
+    chains = {}
+    position = 0
+
+    def insert(index):
+        if index + MIN_MATCH <= len(data):
+            chains.setdefault(data[index:index + MIN_MATCH], []).append(index)
+
+    while position < len(data):
+        run = 0
+        while position + run < len(data) and run < MAX_RUN and data[position + run] == 0xFF:
+            run += 1
+        if run >= MIN_RUN:
+            tokens.append(("run", run))
+            for index in range(position, position + run):
+                insert(index)
+            position += run
+            continue
+
+        best_length = 0
+        best_distance = 0
+        for candidate in reversed(chains.get(data[position:position + MIN_MATCH], [])[-MAX_CHAIN:]):
+            distance = position - candidate
+            if distance >= WINDOW:
+                break
+            length = 0
+            while length < MAX_MATCH and position + length < len(data) and \
+                    data[candidate + length] == data[position + length]:
+                length += 1
+            if length > best_length:
+                best_length = length
+                best_distance = distance
+                if length == MAX_MATCH:
+                    break
+
+        if best_length >= MIN_MATCH:
+            tokens.append(("match", best_distance, best_length))
+            step = best_length
+        else:
+            tokens.append(("literal", data[position]))
+            step = 1
+        for index in range(position, position + step):
+            insert(index)
+        position += step
+
+    output = bytearray(MAGIC + struct.pack("<I", len(data)))
+    for group in range(0, len(tokens), 8):
+        flags = 0
+        body = bytearray()
+        for bit, token in enumerate(tokens[group:group + 8]):
+            if token[0] == "literal":
+                flags |= 1 << bit
+                body.append(token[1])
+            elif token[0] == "match":
+                body += struct.pack("<H", (token[1] << 4) | (token[2] - MIN_MATCH))
+            else:
+                body += struct.pack("<HH", 0, token[1])
+        output.append(flags)
+        output += body
+    return bytes(output)
+
+
+def decompress(container):
+    if container[:4] != MAGIC:
+        raise ValueError("not an RVZ1 container")
+    (length,) = struct.unpack_from("<I", container, 4)
+    output = bytearray()
+    position = 8
+    while len(output) < length:
+        flags = container[position]
+        position += 1
+        for bit in range(8):
+            if len(output) >= length:
+                break
+            if flags & (1 << bit):
+                output.append(container[position])
+                position += 1
+                continue
+            (token,) = struct.unpack_from("<H", container, position)
+            position += 2
+            distance = token >> 4
+            if distance == 0:
+                (run,) = struct.unpack_from("<H", container, position)
+                position += 2
+                output += b"\xff" * run
+            else:
+                for _ in range((token & 0xF) + MIN_MATCH):
+                    output.append(output[-distance])
+    return bytes(output)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("input", help="raw firmware image")
+    parser.add_argument("output", help="container to write")
+    args = parser.parse_args()
+
+    with open(args.input, "rb") as f:
+        data = f.read()
+    container = compress(data)
+    if decompress(container) != data:
+        sys.exit("round trip check failed")
+    with open(args.output, "wb") as f:
+        f.write(container)
+    print(f"{args.input}: {len(data)} -> {len(container)} bytes ({100 * len(container) / max(len(data), 1):.1f}%)")
+
+
+if __name__ == "__main__":
+    main()